@@ -38,18 +38,43 @@ int main() {
     strcpy(buf, "Finish GPID_FILE initialization");
     grass->sys_send(GPID_PROCESS, buf, 32);
 
-    /* Wait for inode read or write requests. */
+    /* Wait for inode read or write requests; reply to a request and wait
+     * for the next one in a single system call. FILE_READ_PAGE replies with
+     * page_buf, which the kernel swaps with the page of the client. */
+    static char page_buf[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+    int sender, r;
+    uint size;
+    grass->sys_recv(GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
     while (1) {
-        int sender, r;
         struct file_request* req = (void*)buf;
         struct file_reply* reply = (void*)buf;
-        grass->sys_recv(GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
 
         switch (req->type) {
         case FILE_READ:
             r = fs->read(fs, req->ino, req->offset, (void*)&reply->block);
             reply->status = r == 0 ? FILE_OK : FILE_ERROR;
-            grass->sys_send(sender, (void*)reply, sizeof(*reply));
+            grass->sys_reply_recv(sender, (void*)reply, sizeof(*reply),
+                                  GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
+            break;
+        case FILE_READ_PAGE:
+            /* Blocks past the end of the file read as zeros, and so does the
+             * whole page if its first block cannot be read, since page_buf
+             * holds the page of the previous client after an exchange. The
+             * mydisk file system (FILESYS=0) has no file size to check. */
+            r = fs->read(fs, req->ino, req->offset, (void*)page_buf);
+            if (r != 0) memset(page_buf, 0, PAGE_SIZE);
+            size = (r == 0 && FILESYS != 0) ? fs->getsize(fs, req->ino)
+                                            : (uint)-1;
+            for (uint i = 1; i < FILE_PAGE_NBLOCKS && r == 0; i++) {
+                char* block = page_buf + i * BLOCK_SIZE;
+                if (req->offset + i >= size ||
+                    fs->read(fs, req->ino, req->offset + i, (void*)block))
+                    memset(block, 0, BLOCK_SIZE);
+            }
+            reply->status = r == 0 ? FILE_OK : FILE_ERROR;
+            grass->sys_reply_recv_page(
+                sender, (void*)reply, offsetof(struct file_reply, block),
+                page_buf, GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
             break;
         case FILE_WRITE:
             /* The FILE_WRITE case is left to students as an exercise. */
@@ -11,8 +11,12 @@
 #include "disk.h"
 
 static int app_ino, app_pid;
+static struct exec* app_exec;
 static void sys_spawn(uint base);
 static int app_spawn(struct proc_request* req);
+static int app_clone(int pid);
+static void app_fault(int pid, uint vaddr);
+static void app_forget(int pid);
 
 struct multicore {
     int boot_lock, booted_core_cnt; /* See earth/boot.s */
@@ -28,7 +32,7 @@ int main(int unused, struct multicore* boot) {
 
     /* Student's code ends here. */
 
-    int sender, shell_waiting;
+    int sender, shell_waiting, chan;
     char buf[SYSCALL_MSG_LEN];
 
     sys_spawn(SYS_TERM_EXEC_START);
@@ -58,6 +62,7 @@ int main(int unused, struct multicore* boot) {
             break;
         case PROC_EXIT:
             grass->proc_free(sender);
+            app_forget(sender);
 
             if (shell_waiting && app_pid == sender)
                 grass->sys_send(GPID_SHELL, (void*)reply, sizeof(*reply));
@@ -66,10 +71,39 @@ int main(int unused, struct multicore* boot) {
             break;
         case PROC_KILLALL:
             grass->proc_free(GPID_ALL);
+            app_forget(GPID_ALL);
             break;
         /* Student's code goes here (System Call & Protection). */
 
         /* Add a case which handles process sleep. */
+        case PROC_TICKETS:
+            if (req->pid >= GPID_USER_START && req->tickets > 0)
+                grass->proc_set_tickets(req->pid, req->tickets);
+            break;
+        case PROC_CHANNEL:
+            chan        = grass->channel_open(sender, req->pid);
+            reply->type = (chan >= 0) ? CMD_OK : CMD_ERROR;
+            reply->chan = chan;
+            grass->sys_send(sender, (void*)reply, sizeof(*reply));
+            break;
+        case PROC_CLONE:
+            /* Reply to the clone, which waits for the reply like sender. */
+            reply->pid  = app_clone(sender);
+            reply->type = (reply->pid > 0) ? CMD_OK : CMD_ERROR;
+            if (reply->pid > 0) {
+                int clone  = reply->pid;
+                reply->pid = 0;
+                grass->sys_send(clone, (void*)reply, sizeof(*reply));
+                reply->pid = clone;
+            }
+            grass->sys_send(sender, (void*)reply, sizeof(*reply));
+            break;
+        case PROC_FAULT:
+            /* The reply lets the kernel retry the faulting instruction. */
+            app_fault(sender, req->vaddr);
+            reply->type = CMD_OK;
+            grass->sys_send(sender, (void*)reply, sizeof(*reply));
+            break;
 
         /* Student's code ends here. */
         default:
@@ -78,20 +112,191 @@ int main(int unused, struct multicore* boot) {
     }
 }
 
-static void app_read(uint off, char* dst) { file_read(app_ino, off, dst); }
+/* A cache of recently spawned executables, which holds the inode of each,
+ * its parsed program headers, and its blocks up to the end of its last
+ * loadable segment in pages from mmu_alloc, so that spawning it again reads
+ * and parses nothing from GPID_FILE. The least recently spawned executables
+ * are evicted to keep the cache within EXEC_CACHE pages (see Makefile),
+ * which are reused but never freed. */
+#define EXEC_NEXECS    8
+#define EXEC_MAX_PAGES 32
+static struct exec {
+    char name[CMD_ARG_LEN];
+    int ino;
+    uint nblocks, npages, last_use;
+    struct elf_phdrs phdrs;
+    uint page[EXEC_MAX_PAGES];
+} execs[EXEC_NEXECS];
+static uint exec_free[EXEC_NEXECS * EXEC_MAX_PAGES];
+static uint exec_nfree, exec_nalloc, exec_clock;
+
+static char* exec_block(struct exec* e, uint block) {
+    uint ppage_id = e->page[block / FILE_PAGE_NBLOCKS];
+    return (char*)APPS_PAGES_BASE + ppage_id * PAGE_SIZE +
+           block % FILE_PAGE_NBLOCKS * BLOCK_SIZE;
+}
+
+static struct exec* exec_lookup(char* name, int ino) {
+    /* Find an executable by name, or by ino if name is NULL. */
+    for (uint i = 0; i < EXEC_NEXECS; i++)
+        if (execs[i].npages && (name ? !strcmp(execs[i].name, name)
+                                     : execs[i].ino == ino))
+            return &execs[i];
+    return NULL;
+}
+
+static void exec_evict(struct exec* e) {
+    while (e->npages) exec_free[exec_nfree++] = e->page[--e->npages];
+}
+
+static uint exec_page_alloc(struct exec* keep) {
+    /* Take a page within the budget, evicting the least recently spawned
+     * executable other than keep if none is left. */
+    if (exec_nfree) return exec_free[--exec_nfree];
+    if (exec_nalloc < EXEC_CACHE) {
+        exec_nalloc++;
+        return earth->mmu_alloc();
+    }
+
+    struct exec* lru = NULL;
+    for (uint i = 0; i < EXEC_NEXECS; i++)
+        if (&execs[i] != keep && execs[i].npages &&
+            (!lru || execs[i].last_use < lru->last_use))
+            lru = &execs[i];
+    exec_evict(lru);
+    return exec_free[--exec_nfree];
+}
+
+static struct exec* exec_load(char* name, int ino) {
+    /* Parse the ELF header to find the blocks which elf_load reads. */
+    char buf[BLOCK_SIZE];
+    struct elf_phdrs phdrs;
+    file_read(ino, 0, buf);
+    elf_parse(buf, &phdrs);
+
+    uint nblocks = 1;
+    for (uint i = 0; i < phdrs.phnum; i++) {
+        uint end = phdrs.ph[i].p_offset + phdrs.ph[i].p_filesz;
+        if (end > nblocks * BLOCK_SIZE)
+            nblocks = (end + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+    uint npages = (nblocks + FILE_PAGE_NBLOCKS - 1) / FILE_PAGE_NBLOCKS;
+    if (npages > EXEC_MAX_PAGES || npages > EXEC_CACHE) return NULL;
+
+    /* Take an unused entry, or the least recently spawned one. */
+    struct exec* e = &execs[0];
+    for (uint i = 1; i < EXEC_NEXECS && e->npages; i++)
+        if (!execs[i].npages || execs[i].last_use < e->last_use) e = &execs[i];
+    exec_evict(e);
+
+    while (e->npages < npages) e->page[e->npages++] = exec_page_alloc(e);
+    memcpy(exec_block(e, 0), buf, BLOCK_SIZE);
+    for (uint block = 1; block < nblocks; block++)
+        file_read(ino, block, exec_block(e, block));
+
+    strcpy(e->name, name);
+    e->ino     = ino;
+    e->nblocks = nblocks;
+    e->phdrs   = phdrs;
+    return e;
+}
+
+static void app_read(uint off, char* dst) {
+    if (app_exec && off < app_exec->nblocks)
+        memcpy(dst, exec_block(app_exec, off), BLOCK_SIZE);
+    else
+        file_read(app_ino, off, dst);
+}
+
+/* The executables of running user processes, whose pages are loaded on
+ * their first access when page tables are used; see elf_fault. Instances
+ * of the same executable share the pages of its code, which are freed with
+ * the last instance; see elf_load. A code page loaded by one instance is
+ * mapped to all the others at once, so that every instance maps all the
+ * code pages loaded so far; see app_fault. */
+#define NAPPS 16
+static struct app {
+    int pid, ino;
+    struct elf_image image;
+} apps[NAPPS];
 
 static int app_spawn(struct proc_request* req) {
-    int bin_ino = dir_lookup(0, "bin/");
-    if ((app_ino = dir_lookup(bin_ino, req->argv[0])) < 0) return CMD_ERROR;
+    if ((app_exec = exec_lookup(req->argv[0], 0))) {
+        app_ino = app_exec->ino;
+    } else {
+        int bin_ino = dir_lookup(0, "bin/");
+        if ((app_ino = dir_lookup(bin_ino, req->argv[0])) < 0) return CMD_ERROR;
+        app_exec = exec_load(req->argv[0], app_ino);
+    }
+    if (app_exec) app_exec->last_use = ++exec_clock;
     int argc = req->argv[req->argc - 1][0] == '&' ? req->argc - 1 : req->argc;
 
+    struct app* app = NULL;
+    for (uint i = 0; i < NAPPS && !app; i++)
+        if (apps[i].pid == 0) app = &apps[i];
+    if (app) app->image.ntext = 0;
+    for (uint i = 0; i < NAPPS && app; i++)
+        if (apps[i].pid && apps[i].ino == app_ino) app->image = apps[i].image;
+
     app_pid = grass->proc_alloc();
-    elf_load(app_pid, app_read, argc, (void**)req->argv);
+    elf_load(app_pid, app_read, app_exec ? &app_exec->phdrs : NULL, argc,
+             (void**)req->argv, app ? &app->image : NULL);
+    if (app) {
+        app->pid = app_pid;
+        app->ino = app_ino;
+    }
     grass->proc_set_ready(app_pid);
 
     return CMD_OK;
 }
 
+static int app_clone(int pid) {
+    /* The clone of an app loads the pages of the same executable on page
+     * faults, so it takes an entry in apps too. */
+    struct app *app = NULL, *clone = NULL;
+    for (uint i = 0; i < NAPPS; i++) {
+        if (apps[i].pid == pid) app = &apps[i];
+        if (apps[i].pid == 0 && !clone) clone = &apps[i];
+    }
+    if (pid < GPID_USER_START || (app && !clone)) return -1;
+
+    int clone_pid = grass->proc_clone(pid);
+    if (app && clone_pid > 0) {
+        *clone     = *app;
+        clone->pid = clone_pid;
+    }
+    return clone_pid;
+}
+
+static void app_fault(int pid, uint vaddr) {
+    struct app* app = NULL;
+    for (uint i = 0; i < NAPPS && !app; i++)
+        if (apps[i].pid == pid) app = &apps[i];
+    if (app) {
+        app_ino  = app->ino;
+        app_exec = exec_lookup(NULL, app_ino);
+    }
+    if (!app || elf_fault(pid, app_read, &app->image, vaddr) < 0)
+        FATAL("sys_process: process %d faults at 0x%x", pid, vaddr);
+
+    for (uint i = 0; i < NAPPS; i++) {
+        struct elf_image* image = &apps[i].image;
+        if (!apps[i].pid || apps[i].ino != app->ino || &apps[i] == app)
+            continue;
+        for (uint k = 0; k < app->image.ntext; k++) {
+            if (image->text[k] == app->image.text[k]) continue;
+            image->text[k] = app->image.text[k];
+            earth->mmu_map_shared(apps[i].pid, APPS_ENTRY / PAGE_SIZE + k,
+                                  image->text[k]);
+        }
+    }
+}
+
+static void app_forget(int pid) {
+    for (uint i = 0; i < NAPPS; i++)
+        if (pid == GPID_ALL || apps[i].pid == pid) apps[i].pid = 0;
+}
+
 static int sys_apps_base;
 char* sys_apps[] = {"sys_process", "sys_terminal", "sys_file", "sys_shell"};
 
@@ -104,6 +309,6 @@ static void sys_spawn(uint base) {
     INFO("Load kernel process #%d: %s", pid, sys_apps[pid - 1]);
 
     sys_apps_base = base;
-    elf_load(pid, sys_proc_read, 0, NULL);
+    elf_load(pid, sys_proc_read, NULL, 0, NULL, NULL);
     grass->proc_set_ready(pid);
 }
@@ -36,11 +36,25 @@ int main() {
 
             /* Add proc_coresinfo() from process.c into the grass interface;
              * Invoke proc_coresinfo() to show the pid running on each core. */
+            grass->proc_coresinfo();
 
             /* Student's code ends here. */
+        } else if (strcmp(buf, "trace") == 0) {
+            /* Drain and print the scheduler events recorded by the kernel
+             * in one call, which leaves the events caused by printing them
+             * for the next trace command. */
+            char* names[] = {"INTR", "SCHED", "MLFQ", "BOOST"};
+            static struct sched_event ev[SCHED_TRACE_NEVENTS];
+            uint n = grass->sched_trace(ev, SCHED_TRACE_NEVENTS);
+            for (uint i = 0; i < n; i++)
+                printf("[%s] time = %d ms | core = %d | pid = %d | level = %d "
+                       "| runtime = %d\n\r",
+                       names[ev[i].type], (int)(ev[i].time / 1000), ev[i].core,
+                       ev[i].pid, ev[i].level, ev[i].runtime);
         } else if (strcmp(buf, "killall") == 0) {
             req.type = PROC_KILLALL;
-            grass->sys_send(GPID_PROCESS, (void*)&req, sizeof(req));
+            grass->sys_send(GPID_PROCESS, (void*)&req,
+                            offsetof(struct proc_request, argv));
         } else if (strcmp(buf, "clear") == 0) {
             printf("\e[1;1H\e[2J");
         } else if (strcmp(buf, "pwd") == 0) {
@@ -50,9 +64,10 @@ int main() {
             if (0 != parse_request(buf, &req)) {
                 INFO("sys_shell: too many arguments or argument too long");
             } else {
-                grass->sys_send(GPID_PROCESS, (void*)&req, sizeof(req));
-                grass->sys_recv(GPID_PROCESS, NULL, (void*)&reply,
-                                sizeof(reply));
+                grass->sys_call(GPID_PROCESS, (void*)&req,
+                                offsetof(struct proc_request, argv) +
+                                    req.argc * CMD_ARG_LEN,
+                                (void*)&reply, sizeof(reply));
 
                 if (reply.type != CMD_OK)
                     INFO("sys_shell: command %s not found", req.argv[0]);
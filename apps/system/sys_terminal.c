@@ -8,6 +8,16 @@
 
 #include "app.h"
 
+static void term_drain(int sender) {
+    /* Print everything in the output channel of sender, if any. */
+    int chan = grass->channel_lookup(GPID_TERMINAL, sender);
+    if (chan < 0) return;
+
+    char out[TERM_BUF_SIZE];
+    for (uint n; (n = chan_read(chan, out, TERM_BUF_SIZE)) != 0;)
+        term_write(out, n);
+}
+
 int main() {
     SUCCESS("Enter kernel process GPID_TERMINAL");
 
@@ -15,22 +25,43 @@ int main() {
     strcpy(buf, "Finish GPID_TERMINAL initialization");
     grass->sys_send(GPID_PROCESS, buf, 36);
 
+    int sender;
+    uint len = grass->sys_recv(GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
     while (1) {
-        int sender;
         struct term_request* req = (void*)buf;
         struct term_reply* reply = (void*)buf;
-        grass->sys_recv(GPID_ALL, &sender, (void*)req, SYSCALL_MSG_LEN);
+
+        /* An empty message is the doorbell of the output channel. */
+        if (len == 0) {
+            term_drain(sender);
+            len = grass->sys_recv(GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
+            continue;
+        }
 
         if (req->len > TERM_BUF_SIZE)
             FATAL("sys_terminal: request len %d>TERM_BUF_SIZE", req->len);
 
         switch (req->type) {
         case TERM_INPUT:
+            /* Print the output written before the input request first. */
+            term_drain(sender);
             reply->len = term_read(reply->buf, req->len);
-            grass->sys_send(sender, (void*)reply, sizeof(*reply));
+            /* Reply and wait for the next request in one system call. */
+            len = grass->sys_reply_recv(
+                sender, (void*)reply,
+                offsetof(struct term_reply, buf) + reply->len, GPID_ALL,
+                &sender, buf, SYSCALL_MSG_LEN);
             break;
         case TERM_OUTPUT:
             term_write(req->buf, req->len);
+            len = grass->sys_recv(GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
+            break;
+        case TERM_FLUSH:
+            term_drain(sender);
+            reply->len = 0;
+            len        = grass->sys_reply_recv(
+                sender, (void*)reply, offsetof(struct term_reply, buf),
+                GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
             break;
         default:
             FATAL("sys_terminal: invalid request %d", req->type);
@@ -14,7 +14,8 @@ int main(int argc, char** argv){
         return -1;
     }
 
-    char buf[BLOCK_SIZE]; 
+    /* Read a page of blocks per request; see file_read_page. */
+    static char buf[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
     char line[BLOCK_SIZE];
     int  line_length = 0;
 
@@ -22,12 +23,12 @@ int main(int argc, char** argv){
     int block = 0;
 
     while (keep_reading) {
-        file_read(file_ino, block, buf);
-        block++;
+        file_read_page(file_ino, block, buf);
+        block += FILE_PAGE_NBLOCKS;
 
-        for (int i = 0; i < BLOCK_SIZE && keep_reading; ++i) {
+        for (int i = 0; i < PAGE_SIZE && keep_reading; ++i) {
             char current_character = buf[i];
-            char next_character    = (i + 1 < BLOCK_SIZE) ? buf[i + 1] : '\0';
+            char next_character    = (i + 1 < PAGE_SIZE) ? buf[i + 1] : '\0';
 
             if (current_character == '\0') {
                 if (line_length > 0) {
@@ -50,7 +51,7 @@ int main(int argc, char** argv){
 
             else if (current_character == '.') {
                 int only_spaces_or_null = 1;
-                for (int j = i + 1; j < BLOCK_SIZE; ++j) {
+                for (int j = i + 1; j < PAGE_SIZE; ++j) {
                     if (buf[j] == '\0') {
                         break;
                     }
@@ -0,0 +1,172 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: IPC micro-benchmarks
+ * Measure the cost of an IPC operation in CPU cycles (rdcycle) and in mtime
+ * ticks, and print one line per benchmark for parsing after a QEMU run:
+ *   ipcbench NAME n=N cycles min=X median=Y p99=Z mtime min=X median=Y p99=Z
+ *
+ * Usage: ipcbench echo &          run the peer of ping and burst
+ *        ipcbench ping PID [N]    round trips with the echo server PID
+ *        ipcbench burst PID [N]   back-to-back sys_send to the echo server
+ *        ipcbench file [N]        round trips with GPID_FILE (block read)
+ *        ipcbench term [N]        round trips with GPID_TERMINAL (flush)
+ */
+
+#include "app.h"
+#include <stdlib.h>
+
+#define NSAMPLES   1000
+#define MTIME_BASE (CLINT_BASE + 0xBFF8)
+
+struct bench_msg {
+    enum { BENCH_PING, BENCH_BURST, BENCH_SYNC } op;
+    uint seq;
+};
+
+static uint cycles[NSAMPLES], ticks[NSAMPLES];
+static uint cycle0, tick0;
+
+static uint rdcycle() {
+    uint x;
+    asm volatile("rdcycle %0" : "=r"(x));
+    return x;
+}
+
+static void sample_start() {
+    tick0  = REGW(MTIME_BASE, 0);
+    cycle0 = rdcycle();
+}
+
+static void sample_end(uint i) {
+    cycles[i] = rdcycle() - cycle0;
+    ticks[i]  = REGW(MTIME_BASE, 0) - tick0;
+}
+
+static int cmp(const void* a, const void* b) {
+    uint x = *(uint*)a, y = *(uint*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(char* name, uint n) {
+    qsort(cycles, n, sizeof(uint), cmp);
+    qsort(ticks, n, sizeof(uint), cmp);
+    uint p99 = n * 99 / 100;
+    printf("ipcbench %s n=%u cycles min=%u median=%u p99=%u "
+           "mtime min=%u median=%u p99=%u\n\r",
+           name, n, cycles[0], cycles[n / 2], cycles[p99], ticks[0],
+           ticks[n / 2], ticks[p99]);
+}
+
+static void echo() {
+    /* Reply to BENCH_PING and BENCH_SYNC; only receive BENCH_BURST. */
+    int sender;
+    struct bench_msg msg;
+    sys_recv(GPID_ALL, &sender, (void*)&msg, sizeof(msg));
+    while (1) {
+        if (msg.op == BENCH_BURST) {
+            sys_recv(GPID_ALL, &sender, (void*)&msg, sizeof(msg));
+        } else {
+            sys_reply_recv(sender, (void*)&msg, sizeof(msg), GPID_ALL, &sender,
+                           (void*)&msg, sizeof(msg));
+        }
+    }
+}
+
+static void ping(int pid, uint n) {
+    struct bench_msg msg = {BENCH_PING, 0};
+    for (uint i = 0; i < n; i++) {
+        msg.seq = i;
+        sample_start();
+        uint len =
+            sys_call(pid, (void*)&msg, sizeof(msg), (void*)&msg, sizeof(msg));
+        sample_end(i);
+        if (len == SYS_FAILED) {
+            INFO("ipcbench: no echo server at pid %d", pid);
+            return;
+        }
+    }
+    report("ping", n);
+}
+
+static void burst(int pid, uint n) {
+    /* Time each send, then wait until the echo server drains the burst. */
+    struct bench_msg msg = {BENCH_BURST, 0};
+    for (uint i = 0; i < n; i++) {
+        msg.seq = i;
+        sample_start();
+        int r = sys_send(pid, (void*)&msg, sizeof(msg));
+        sample_end(i);
+        if (r < 0) {
+            INFO("ipcbench: no echo server at pid %d", pid);
+            return;
+        }
+    }
+    msg.op = BENCH_SYNC;
+    if (sys_call(pid, (void*)&msg, sizeof(msg), (void*)&msg, sizeof(msg)) ==
+        SYS_FAILED) {
+        INFO("ipcbench: no echo server at pid %d", pid);
+        return;
+    }
+    report("burst", n);
+}
+
+static void file(uint n) {
+    char buf[BLOCK_SIZE];
+    for (uint i = 0; i < n; i++) {
+        sample_start();
+        file_read(workdir_ino, 0, buf);
+        sample_end(i);
+    }
+    report("file", n);
+}
+
+static void term(uint n) {
+    /* TERM_FLUSH is a round trip which prints nothing. */
+    struct term_request req;
+    struct term_reply reply;
+    req.type = TERM_FLUSH;
+    req.len  = 0;
+    for (uint i = 0; i < n; i++) {
+        sample_start();
+        sys_call(GPID_TERMINAL, (void*)&req, offsetof(struct term_request, buf),
+                 (void*)&reply, sizeof(reply));
+        sample_end(i);
+    }
+    report("term", n);
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "echo") == 0) {
+        echo();
+        return 0;
+    }
+
+    /* ping and burst take the pid of the echo server before N. */
+    int with_pid = argc >= 2 && (strcmp(argv[1], "ping") == 0 ||
+                                 strcmp(argv[1], "burst") == 0);
+    int nargs    = with_pid ? 3 : 2;
+    int pid      = (with_pid && argc >= 3) ? atoi(argv[2]) : 0;
+    uint n       = (argc == nargs + 1) ? atoi(argv[nargs]) : NSAMPLES;
+    if (n == 0 || n > NSAMPLES) n = NSAMPLES;
+
+    if (argc < nargs || argc > nargs + 1 || (with_pid && pid <= 0)) {
+        INFO("usage: ipcbench [echo|ping PID|burst PID|file|term] [N]");
+        return -1;
+    }
+
+    if (strcmp(argv[1], "ping") == 0) {
+        ping(pid, n);
+    } else if (strcmp(argv[1], "burst") == 0) {
+        burst(pid, n);
+    } else if (strcmp(argv[1], "file") == 0) {
+        file(n);
+    } else if (strcmp(argv[1], "term") == 0) {
+        term(n);
+    } else {
+        INFO("usage: ipcbench [echo|ping PID|burst PID|file|term] [N]");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: set the CPU share of a process under the stride scheduler
+ */
+
+#include "app.h"
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+    if (argc != 3 || atoi(argv[1]) < GPID_USER_START || atoi(argv[2]) <= 0) {
+        INFO("usage: tickets [PID] [TICKETS]");
+        return -1;
+    }
+
+    struct proc_request req;
+    req.type    = PROC_TICKETS;
+    req.pid     = atoi(argv[1]);
+    req.tickets = atoi(argv[2]);
+    sys_send(GPID_PROCESS, (void*)&req, offsetof(struct proc_request, argv));
+    return 0;
+}
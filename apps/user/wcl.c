@@ -13,7 +13,8 @@ int main(int argc, char **argv) {
             return -1; 
         }
 
-        char buf[BLOCK_SIZE]; 
+        /* Read a page of blocks per request; see file_read_page. */
+        static char buf[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
         char line[1024]; 
         int line_length = 0; 
         int line_count = 0; 
@@ -21,17 +22,17 @@ int main(int argc, char **argv) {
         int keep_reading = 1;
 
         while (keep_reading) {
-            file_read(file_ino, offset, buf); 
-            offset++;
+            file_read_page(file_ino, offset, buf); 
+            offset += FILE_PAGE_NBLOCKS;
 
-            for (int j = 0; j < BLOCK_SIZE; ++j) { 
+            for (int j = 0; j < PAGE_SIZE; ++j) { 
                 char current_character = buf[j]; 
                 if (current_character == '\0') { 
                     keep_reading = 0; 
                     break;
                 }
 
-                char next_character = (j + 1 < BLOCK_SIZE) ? buf[j + 1] : '\0';
+                char next_character = (j + 1 < PAGE_SIZE) ? buf[j + 1] : '\0';
 
                 if (current_character == '\n' ||
                    (current_character == '.' && (next_character == '\0' || next_character == ' '))) { 
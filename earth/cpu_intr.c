@@ -28,8 +28,12 @@ static void mtimecmp_set(ulonglong time, uint core_id) {
     REGW(MTIMECMP_BASE, core_id * 8 + 4) = (uint)(time >> 32);
 }
 
-static void timer_reset(uint core_id) {
-    mtimecmp_set(mtime_get() + QUANTUM, core_id);
+static void timer_reset(uint core_id, uint nquantum, ulonglong wakeup) {
+    /* Interrupt at the end of the slice or at wakeup, whichever is first;
+     * nquantum is 0 when only the wakeup is needed. */
+    ulonglong slice_end = nquantum ? mtime_get() + (ulonglong)nquantum * QUANTUM
+                                   : (ulonglong)-1;
+    mtimecmp_set(wakeup < slice_end ? wakeup : slice_end, core_id);
 }
 
 void trap_entry(); /* See grass/kernel.s */
@@ -46,4 +50,7 @@ void intr_init(uint core_id) {
     asm("csrw mip, %0" ::"r"(0));
     asm("csrs mie, %0" ::"r"(0x80));
     asm("csrs mstatus, %0" ::"r"(0x88));
+
+    /* Allow rdcycle and rdinstret in user mode (see apps/user/ipcbench.c). */
+    asm("csrw mcounteren, %0" ::"r"(0x5));
 }
@@ -11,53 +11,327 @@
 #include <string.h>
 
 #define PAGE_SIZE          4096
-#define PAGE_NO_TO_ADDR(x) (char*)(x * PAGE_SIZE)
+#define PAGE_NO_TO_ADDR(x) ((char*)((x) * PAGE_SIZE))
 #define PAGE_ID_TO_ADDR(x) ((char*)APPS_PAGES_BASE + x * PAGE_SIZE)
 #define APPS_PAGES_CNT     (RAM_END - APPS_PAGES_BASE) / PAGE_SIZE
 
+#define NO_PAGE -1
+#define OWNER   0 /* the lists of pages mapped by pid as page->pid  */
+#define PEER    1 /* the lists of pages mapped by pid as page->peer */
+
 struct page_info {
     int use;
     int pid;
     uint vpage_no;
+    int peer; /* a second pid mapping the page at vpage_no, see mmu_share */
+    int ref;  /* the pids mapping the page read-only, see mmu_map_shared  */
+    int cow;  /* a shared page copied on the first write, see mmu_clone  */
+    int prev[2], next[2]; /* the lists of pid and peer; next[0] when free */
+    ulonglong checksum;   /* of the page when copied in by soft_tlb_load */
 } page_info_table[APPS_PAGES_CNT];
+static int free_head;
+
+/* In software TLB mode, the user address space [APPS_ENTRY, APPS_STACK_TOP)
+ * holds copies of physical pages, and resident[v] is the page copied to the
+ * v-th virtual page. A copy stays in place after switching to a process which
+ * does not use its virtual page, so that switching back copies nothing. */
+#define USER_VPAGE_BASE (APPS_ENTRY / PAGE_SIZE)
+#define USER_VPAGE_CNT  ((APPS_STACK_TOP - APPS_ENTRY) / PAGE_SIZE)
+#define USER_VPAGE(i)   (page_info_table[i].vpage_no - USER_VPAGE_BASE)
+static int resident[USER_VPAGE_CNT];
+static int curr_vm_pid = -1, curr_vm_writer = -1;
+
+/* The owner_map is an open-addressed hash table (with linear probing) from
+ * a pid to the heads of its OWNER and PEER page lists, so that freeing the
+ * pages of pid takes time proportional to the number of pages it maps. Pages
+ * of pid 0 (e.g., the page tables of the kernel) are in no list.
+ *
+ * Pages shared by any number of pids, i.e., the read-only code of several
+ * instances of an app (see mmu_map_shared) and the copy-on-write pages of
+ * cloned processes (see mmu_clone), have pid 0 and a reference count instead,
+ * and each pid mapping such a page has a page_ref to it in its shared list. */
+#define OWNER_MAP_SIZE 64
+#define OWNER_HASH(x)  ((uint)(x) % OWNER_MAP_SIZE)
+static struct page_owner {
+    int use, pid, head[2];
+    uint* root; /* the root page table of pid, see page_table_map */
+    uint asid;  /* the ASID of pid if asid_pid[asid] == pid      */
+    int shared; /* the head of the page_refs of pid              */
+} owner_map[OWNER_MAP_SIZE];
+
+#define PAGE_REF_CNT (APPS_PAGES_CNT * 2)
+static struct page_ref {
+    int page, next;
+} page_ref_table[PAGE_REF_CNT];
+static int ref_free_head;
+
+static struct page_owner* owner_lookup(int pid, int create) {
+    uint i = OWNER_HASH(pid);
+    for (uint n = 0; n < OWNER_MAP_SIZE; n++, i = (i + 1) % OWNER_MAP_SIZE) {
+        if (owner_map[i].use && owner_map[i].pid == pid) return &owner_map[i];
+        if (owner_map[i].use) continue;
+        if (!create) return NULL;
+
+        owner_map[i] = (struct page_owner){1, pid, {NO_PAGE, NO_PAGE}};
+        owner_map[i].shared = NO_PAGE;
+        return &owner_map[i];
+    }
+    if (create) FATAL("owner_lookup: too many processes own pages");
+    return NULL;
+}
+
+static void owner_remove(struct page_owner* o) {
+    /* Shift later entries of the probe chain back into the hole, unless
+     * their home slot lies cyclically within (hole, entry]. */
+    uint i = o - owner_map;
+    for (uint j = (i + 1) % OWNER_MAP_SIZE; owner_map[j].use;
+         j = (j + 1) % OWNER_MAP_SIZE) {
+        uint h = OWNER_HASH(owner_map[j].pid);
+        if (j > i ? (h <= i || h > j) : (h <= i && h > j)) {
+            owner_map[i] = owner_map[j];
+            i            = j;
+        }
+    }
+    owner_map[i].use = 0;
+}
+
+static int owner_empty(struct page_owner* o) {
+    return o->head[OWNER] == NO_PAGE && o->head[PEER] == NO_PAGE &&
+           o->shared == NO_PAGE;
+}
+
+static void page_link(int i, int k, int pid) {
+    /* Insert page i at the head of list k of pid. */
+    struct page_owner* o       = owner_lookup(pid, 1);
+    page_info_table[i].prev[k] = NO_PAGE;
+    page_info_table[i].next[k] = o->head[k];
+    if (o->head[k] != NO_PAGE) page_info_table[o->head[k]].prev[k] = i;
+    o->head[k] = i;
+}
+
+static void page_unlink(int i, int k, int pid) {
+    struct page_owner* o = owner_lookup(pid, 0);
+    int prev = page_info_table[i].prev[k], next = page_info_table[i].next[k];
+    if (prev != NO_PAGE) page_info_table[prev].next[k] = next;
+    else o->head[k] = next;
+    if (next != NO_PAGE) page_info_table[next].prev[k] = prev;
+
+    if (owner_empty(o)) owner_remove(o);
+}
+
+static void page_ref_add(int pid, int i) {
+    /* Add a reference of pid to the shared page i. */
+    if (ref_free_head == NO_PAGE) FATAL("page_ref_add: too many shared pages");
+    struct page_owner* o = owner_lookup(pid, 1);
+    int r                = ref_free_head;
+    ref_free_head        = page_ref_table[r].next;
+    page_ref_table[r]    = (struct page_ref){i, o->shared};
+    o->shared            = r;
+    page_info_table[i].ref++;
+}
+
+static int page_ref_remove(int pid, int i) {
+    /* Remove the reference of pid to the shared page i, and return 0, or -1
+     * if pid has no such reference; the page is not freed here. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    for (int* r = o ? &o->shared : NULL; r && *r != NO_PAGE;
+         r = &page_ref_table[*r].next) {
+        if (page_ref_table[*r].page != i) continue;
+
+        int next                = page_ref_table[*r].next;
+        page_ref_table[*r].next = ref_free_head;
+        ref_free_head           = *r;
+        *r                      = next;
+        page_info_table[i].ref--;
+        if (owner_empty(o)) owner_remove(o);
+        return 0;
+    }
+    return -1;
+}
+
+static int page_ref_lookup(int pid, uint vpage_no) {
+    /* Return the shared page of pid at vpage_no, or NO_PAGE. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    for (int r = o ? o->shared : NO_PAGE; r != NO_PAGE;
+         r = page_ref_table[r].next)
+        if (page_info_table[page_ref_table[r].page].vpage_no == vpage_no)
+            return page_ref_table[r].page;
+    return NO_PAGE;
+}
+
+static void page_own(int i, int pid) {
+    /* Make pid the owner of page i, moving i from the list of the old one. */
+    struct page_info* page = &page_info_table[i];
+    if (page->pid == pid) return;
+    if (page->pid) page_unlink(i, OWNER, page->pid);
+    page->pid = pid;
+    if (pid) page_link(i, OWNER, pid);
+}
 
 uint mmu_alloc() {
-    for (uint i = 0; i < APPS_PAGES_CNT; i++)
-        if (!page_info_table[i].use) {
-            page_info_table[i].use = 1;
-            return i;
+    if (free_head == NO_PAGE) FATAL("mmu_alloc: no more free memory");
+
+    uint i    = free_head;
+    free_head = page_info_table[i].next[0];
+    memset(&page_info_table[i], 0, sizeof(struct page_info));
+    page_info_table[i].use = 1;
+    return i;
+}
+
+static void page_free(int i) {
+    /* The copy of page i in the user address space is discarded. */
+    if (USER_VPAGE(i) < USER_VPAGE_CNT && resident[USER_VPAGE(i)] == i)
+        resident[USER_VPAGE(i)] = NO_PAGE;
+
+    memset(&page_info_table[i], 0, sizeof(struct page_info));
+    page_info_table[i].next[0] = free_head;
+    free_head                  = i;
+}
+
+static void page_table_set(int pid, uint vpage_no, uint paddr);
+static void page_table_set_rx(int pid, uint vpage_no, uint paddr);
+static void page_table_unmap(int pid, uint ppage_id);
+static void page_table_free(int pid);
+
+static void page_unshare(int pid, uint ppage_id) {
+    /* Drop the reference of pid to a shared page, and free the page if it
+     * was the last one. */
+    if (page_ref_remove(pid, ppage_id) < 0) return;
+    if (earth->translation == PAGE_TABLE) page_table_unmap(pid, ppage_id);
+    if (page_info_table[ppage_id].ref == 0) page_free(ppage_id);
+}
+
+void mmu_unmap(int pid, uint ppage_id) {
+    /* Drop pid from the page, and free the page if no pid maps it. */
+    struct page_info* page = &page_info_table[ppage_id];
+    if (page->ref) {
+        page_unshare(pid, ppage_id);
+        return;
+    }
+    if (page->pid != pid && page->peer != pid) return;
+    if (earth->translation == PAGE_TABLE) page_table_unmap(pid, ppage_id);
+
+    if (page->peer == pid) {
+        page_unlink(ppage_id, PEER, pid);
+        page->peer = 0;
+    } else {
+        int peer = page->peer;
+        if (!peer) {
+            page_unlink(ppage_id, OWNER, pid);
+            page_free(ppage_id);
+            return;
         }
-    FATAL("mmu_alloc: no more free memory");
+        page_unlink(ppage_id, PEER, peer);
+        page->peer = 0;
+        page_own(ppage_id, peer);
+    }
 }
 
 void mmu_free(int pid) {
-    for (uint i = 0; i < APPS_PAGES_CNT; i++)
-        if (page_info_table[i].use && page_info_table[i].pid == pid)
-            memset(&page_info_table[i], 0, sizeof(struct page_info));
+    if (earth->translation == PAGE_TABLE) page_table_free(pid);
+
+    struct page_owner* o;
+    while ((o = owner_lookup(pid, 0))) {
+        int i = (o->head[OWNER] != NO_PAGE) ? o->head[OWNER] : o->head[PEER];
+        if (i == NO_PAGE) i = page_ref_table[o->shared].page;
+        mmu_unmap(pid, i);
+    }
+}
+
+void mmu_share(int pid, uint ppage_id) {
+    /* Map a page of another process to pid at the same virtual address. */
+    struct page_info* page = &page_info_table[ppage_id];
+    if (page->peer) page_unlink(ppage_id, PEER, page->peer);
+    page->peer = pid;
+    page_link(ppage_id, PEER, pid);
+    if (pid == curr_vm_pid) curr_vm_pid = -1; /* copy it in on next switch */
+    if (earth->translation == PAGE_TABLE)
+        page_table_set(pid, page->vpage_no, (uint)PAGE_ID_TO_ADDR(ppage_id));
 }
 
 void soft_tlb_map(int pid, uint vpage_no, uint ppage_id) {
-    page_info_table[ppage_id].pid      = pid;
+    page_own(ppage_id, pid);
     page_info_table[ppage_id].vpage_no = vpage_no;
+    if (pid == curr_vm_pid) curr_vm_pid = -1; /* copy it in on next switch */
 }
 
-void soft_tlb_switch(int pid) {
-    static int curr_vm_pid = -1;
-    if (pid == curr_vm_pid) return;
+static ulonglong page_checksum(char* addr) {
+    /* Fletcher-style sums over words, so that a reordering also counts. */
+    uint a = 0, b = 0, *w = (uint*)addr;
+    for (uint i = 0; i < PAGE_SIZE / sizeof(uint); i++) {
+        a += w[i];
+        b += a;
+    }
+    return ((ulonglong)b << 32) | a;
+}
 
-    /* Unmap curr_vm_pid from the user address space. */
-    for (uint i = 0; i < APPS_PAGES_CNT; i++)
-        if (page_info_table[i].use && page_info_table[i].pid == curr_vm_pid)
-            memcpy(PAGE_ID_TO_ADDR(i),
-                   PAGE_NO_TO_ADDR(page_info_table[i].vpage_no), PAGE_SIZE);
+static void soft_tlb_evict(uint v) {
+    /* Write the copy at virtual page v back, unless its checksum shows that
+     * it has not been modified since soft_tlb_load copied it in. The writes
+     * to a shared page are discarded, since the page is read-only, or it is
+     * copy-on-write and soft_tlb_cow has copied the writes already. */
+    int i = resident[v];
+    if (i == NO_PAGE) return;
+
+    char* vaddr = PAGE_NO_TO_ADDR(USER_VPAGE_BASE + v);
+    if (!page_info_table[i].ref &&
+        page_checksum(vaddr) != page_info_table[i].checksum)
+        memcpy(PAGE_ID_TO_ADDR(i), vaddr, PAGE_SIZE);
+    resident[v] = NO_PAGE;
+}
 
-    /* Map pid to the user address space. */
-    for (uint i = 0; i < APPS_PAGES_CNT; i++)
-        if (page_info_table[i].use && page_info_table[i].pid == pid)
-            memcpy(PAGE_NO_TO_ADDR(page_info_table[i].vpage_no),
-                   PAGE_ID_TO_ADDR(i), PAGE_SIZE);
+static void soft_tlb_load(int i) {
+    /* Copy page i in, unless it is already in place. */
+    uint v = USER_VPAGE(i);
+    if (v >= USER_VPAGE_CNT) FATAL("soft_tlb_load: vpage out of user space");
+    if (resident[v] == i) return;
 
-    curr_vm_pid = pid;
+    soft_tlb_evict(v);
+    memcpy(PAGE_NO_TO_ADDR(USER_VPAGE_BASE + v), PAGE_ID_TO_ADDR(i), PAGE_SIZE);
+    page_info_table[i].checksum = page_checksum(PAGE_ID_TO_ADDR(i));
+    resident[v]                 = i;
+}
+
+static int page_cow(int pid, int i, char* src);
+
+static void soft_tlb_cow(int pid) {
+    /* Without page faults, the writes of pid to its copy-on-write pages are
+     * found by their checksums, and pid gets a copy of every modified page
+     * before another pid may copy in the same page. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    for (int r = o ? o->shared : NO_PAGE, next; r != NO_PAGE; r = next) {
+        next        = page_ref_table[r].next;
+        int i       = page_ref_table[r].page;
+        char* vaddr = PAGE_NO_TO_ADDR(page_info_table[i].vpage_no);
+        if (!page_info_table[i].cow || resident[USER_VPAGE(i)] != i ||
+            page_checksum(vaddr) == page_info_table[i].checksum)
+            continue;
+
+        /* The copy in place becomes the copy of pid, and is written back
+         * when evicted if pid has got page i itself. */
+        int j = page_cow(pid, i, vaddr);
+        if (j == i) continue;
+        resident[USER_VPAGE(j)]     = j;
+        page_info_table[j].checksum = page_checksum(vaddr);
+    }
+}
+
+void soft_tlb_switch(int pid) {
+    if (pid == curr_vm_pid) return;
+    if (curr_vm_writer != pid) soft_tlb_cow(curr_vm_writer);
+
+    /* Copy in the pages of pid which are not in place, evicting the pages of
+     * other processes only where pid uses the same virtual pages. A shared
+     * page stays in place when switching between the pids sharing it. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    for (uint k = OWNER; o && k <= PEER; k++)
+        for (int i = o->head[k]; i != NO_PAGE; i = page_info_table[i].next[k])
+            soft_tlb_load(i);
+    for (int r = o ? o->shared : NO_PAGE; r != NO_PAGE;
+         r = page_ref_table[r].next)
+        soft_tlb_load(page_ref_table[r].page);
+
+    curr_vm_pid = curr_vm_writer = pid;
 }
 
 uint soft_tlb_translate(int pid, uint vaddr) {
@@ -65,13 +339,127 @@ uint soft_tlb_translate(int pid, uint vaddr) {
     return vaddr;
 }
 
-/* The code below creates an identity map using page tables (RISC-V Sv32). */
-#define USER_RWX     (0xC0 | 0x1F)
-#define MAX_NPROCESS 256
+static int page_lookup(int pid, uint vpage_no) {
+    struct page_owner* o = owner_lookup(pid, 0);
+    for (int i = o ? o->head[OWNER] : NO_PAGE; i != NO_PAGE;
+         i = page_info_table[i].next[OWNER])
+        if (page_info_table[i].vpage_no == vpage_no) return i;
+    return NO_PAGE;
+}
+
+static void soft_tlb_writeback(int i) {
+    if (resident[USER_VPAGE(i)] == i) soft_tlb_evict(USER_VPAGE(i));
+}
+
+int mmu_exchange(int pid, uint vpage_no, int peer, uint peer_vpage_no) {
+    /* Swap the page of pid at vpage_no and the page of peer at peer_vpage_no
+     * so that both processes keep a page at these addresses. */
+    int src = page_lookup(pid, vpage_no);
+    int dst = page_lookup(peer, peer_vpage_no);
+    if (src == NO_PAGE || dst == NO_PAGE) return -1;
+    if (page_info_table[src].peer || page_info_table[dst].peer) return -1;
+
+    /* With software TLB, the frames must be up to date before they change
+     * hands, and the next soft_tlb_switch copies them in at the new places. */
+    soft_tlb_writeback(src);
+    soft_tlb_writeback(dst);
+    earth->mmu_map(peer, peer_vpage_no, src);
+    earth->mmu_map(pid, vpage_no, dst);
+    return 0;
+}
+
+void mmu_map_shared(int pid, uint vpage_no, uint ppage_id) {
+    /* Map a read-only page to pid, which may already be shared with other
+     * pids at the same virtual page; the last mmu_unmap frees the page. */
+    struct page_info* page = &page_info_table[ppage_id];
+    if (vpage_no - USER_VPAGE_BASE >= USER_VPAGE_CNT || page->pid || page->peer)
+        FATAL("mmu_map_shared: cannot share page #%d at 0x%x", ppage_id,
+              vpage_no);
+
+    int old = page_ref_lookup(pid, vpage_no);
+    if (old == ppage_id) return;
+    if (old != NO_PAGE) page_unshare(pid, old);
+    page->vpage_no = vpage_no;
+    page_ref_add(pid, ppage_id);
+    if (pid == curr_vm_pid) curr_vm_pid = -1; /* copy it in on next switch */
+    if (earth->translation == PAGE_TABLE)
+        page_table_set_rx(pid, vpage_no, (uint)PAGE_ID_TO_ADDR(ppage_id));
+}
+
+static int page_cow(int pid, int i, char* src) {
+    /* Give pid the copy-on-write page i if no other pid shares it, or a new
+     * page with the content at src otherwise; return the page pid maps now. */
+    struct page_info* page = &page_info_table[i];
+    uint vpage_no          = page->vpage_no;
+    int j                  = i;
+    if (page->ref > 1) {
+        j = mmu_alloc();
+        memcpy(PAGE_ID_TO_ADDR(j), src, PAGE_SIZE);
+    } else {
+        page->cow = 0;
+    }
+    earth->mmu_map(pid, vpage_no, j);
+    page_ref_remove(pid, i);
+    return j;
+}
+
+static void page_table_clone(int pid, int child);
+
+int mmu_clone(int pid, int child) {
+    /* Map the pages of pid to child at the same virtual pages, and make the
+     * private pages of pid copy-on-write for both. Child gets no page table
+     * and no channel of pid, and gets a copy of the page at SYSCALL_ARG,
+     * which the kernel writes through the physical address. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    if (!o) return -1;
+    if (pid == curr_vm_pid) curr_vm_pid = -1; /* copy it in on next switch */
+
+    for (int r = o->shared; r != NO_PAGE; r = page_ref_table[r].next) {
+        int i = page_ref_table[r].page;
+        page_ref_add(child, i);
+        if (earth->translation == PAGE_TABLE)
+            page_table_set_rx(child, page_info_table[i].vpage_no,
+                              (uint)PAGE_ID_TO_ADDR(i));
+    }
+
+    for (int i = o->head[OWNER], next; i != NO_PAGE; i = next) {
+        struct page_info* page = &page_info_table[i];
+        next                   = page->next[OWNER];
+        if (!page->vpage_no || page->peer) continue;
+
+        /* With software TLB, the pages must be up to date before sharing. */
+        soft_tlb_writeback(i);
+        if (page->vpage_no == SYSCALL_ARG / PAGE_SIZE) {
+            uint j = mmu_alloc();
+            memcpy(PAGE_ID_TO_ADDR(j), PAGE_ID_TO_ADDR(i), PAGE_SIZE);
+            earth->mmu_map(child, page->vpage_no, j);
+            continue;
+        }
+
+        page_ref_add(pid, i);
+        page_own(i, 0);
+        page_ref_add(child, i);
+        page->cow = 1;
+        if (earth->translation == PAGE_TABLE) {
+            page_table_set_rx(pid, page->vpage_no, (uint)PAGE_ID_TO_ADDR(i));
+            page_table_set_rx(child, page->vpage_no, (uint)PAGE_ID_TO_ADDR(i));
+        }
+    }
+
+    if (earth->translation == PAGE_TABLE) page_table_clone(pid, child);
+    return 0;
+}
+
+/* The code below creates an identity map using page tables (RISC-V Sv32),
+ * over which page_table_map maps the pages of a process. */
+#define USER_RWX         (0xC0 | 0x1F)
+#define USER_RX          (0xC0 | 0x1B)
+#define PTE_FILE         0x100 /* invalid, but backed by the executable */
+#define PTE_TO_ADDR(x)   ((uint*)(((x) << 2) & 0xFFFFF000))
+#define SATP(root, asid) ((1 << 31) | ((asid) << 22) | ((uint)(root) >> 12))
 static uint* root;
 static uint* leaf;
-static uint* pid_to_pagetable_base[MAX_NPROCESS];
-/* Assume at most MAX_NPROCESS unique processes just for simplicity. */
+static uint* kernel_root; /* the tables of pid 0, built by mmu_init */
 
 void setup_identity_region(int pid, uint addr, uint npages, uint flag) {
     uint vpn1 = addr >> 22;
@@ -81,9 +469,9 @@ void setup_identity_region(int pid, uint addr, uint npages, uint flag) {
         leaf = (void*)((root[vpn1] << 2) & 0xFFFFF000);
     } else {
         /* Allocate the leaf page table. */
-        uint ppage_id                 = earth->mmu_alloc();
-        leaf                          = (void*)PAGE_ID_TO_ADDR(ppage_id);
-        page_info_table[ppage_id].pid = pid;
+        uint ppage_id = earth->mmu_alloc();
+        leaf          = (void*)PAGE_ID_TO_ADDR(ppage_id);
+        page_own(ppage_id, pid);
         memset(leaf, 0, PAGE_SIZE);
         root[vpn1] = ((uint)leaf >> 2) | 0x1;
     }
@@ -96,10 +484,17 @@ void setup_identity_region(int pid, uint addr, uint npages, uint flag) {
 
 void pagetable_identity_map(int pid) {
     /* Allocate the root page table. */
-    uint ppage_id                 = earth->mmu_alloc();
-    root                          = (void*)PAGE_ID_TO_ADDR(ppage_id);
-    page_info_table[ppage_id].pid = pid;
-    pid_to_pagetable_base[pid]    = root;
+    uint ppage_id = earth->mmu_alloc();
+    root          = (void*)PAGE_ID_TO_ADDR(ppage_id);
+    page_own(ppage_id, pid);
+
+    if (pid) {
+        /* Share the leaf tables of the kernel; see page_table_set. */
+        memcpy(root, kernel_root, PAGE_SIZE);
+        owner_lookup(pid, 0)->root = root;
+        return;
+    }
+    kernel_root = root;
     memset(root, 0, PAGE_SIZE);
 
     /* Setup the identity map for various memory regions. */
@@ -122,54 +517,182 @@ void pagetable_identity_map(int pid) {
     }
 }
 
-void page_table_map(int pid, uint vpage_no, uint ppage_id) {
-    if (pid >= MAX_NPROCESS) FATAL("page_table_map: pid too large");
-
-    /* Student's code goes here (Virtual Memory). */
-
-    /* Remove the soft_tlb_map below and do the following.
-     * (1) If page tables for pid do not exist, build the tables.
-     *   Case#1: pid < GPID_USER_START
-     * | Start Address | # Pages | Size   | Explanation                        |
-     * +---------------+---------+--------+------------------------------------+
-     * | 0x80000000    | 512     | 2 MB   | EGOS region (code+data+heap+stack) |
-     * | 0x80200000    | 512     | 2 MB   | Apps region (code+data+heap+stack) |
-     * | 0x80400000    | 1024    | 4 MB   | Free memory and video framebuffer  |
-     * | CLINT_BASE    | 16      | 64 KB  | Memory-mapped registers for timer  |
-     * | UART_BASE     | 1       | 4 KB   | Memory-mapped registers for TTY    |
-     * | SPI_BASE      | 1       | 4 KB   | Memory-mapped registers for SD     |
-     *
-     *   Case#2: pid >= GPID_USER_START
-     * | Start Address | # Pages | Size   | Explanation                        |
-     * +---------------+---------+--------+------------------------------------+
-     * | 0x80302000    | 1       | 4 KB   | Work dir (see apps/app.h)          |
-     *
-     * (2) After building page tables for pid (or if page tables for pid exist),
-     *     update the page tables and map vpage_no to ppage_id based on Sv32. */
-    soft_tlb_map(pid, vpage_no, ppage_id);
+/* Sv32 tags TLB entries with the ASID in satp, so that a switch needs no TLB
+ * flush. Processes get ASIDs in [1, nasid), and the kernel tables of pid 0
+ * use ASID 0. When the ASIDs run out, the next one round-robin is taken from
+ * its pid, which gets another ASID when it runs again.
+ *
+ * Remapping a page of an ASID (or giving the ASID to another pid) bumps its
+ * generation, and a core flushes the ASID when it switches to it with an
+ * older generation. This also works for mappings changed in user mode (e.g.,
+ * by sys_proc), where sfence.vma is not allowed, and for the TLBs of other
+ * cores. Without ASID bits in satp (nasid == 1), every switch flushes. */
+#define MAX_NASID 512
+static uint nasid, asid_next = 1;
+static int asid_pid[MAX_NASID];
+static uint asid_gen[MAX_NASID], core_asid_gen[NCORES][MAX_NASID];
+
+static uint asid_alloc(struct page_owner* o) {
+    if (o->asid && asid_pid[o->asid] == o->pid) return o->asid;
+
+    /* Take a free ASID, or the next one round-robin if none is free. */
+    uint asid = asid_next;
+    for (uint n = 0; n < nasid - 1 && asid_pid[asid]; n++)
+        asid = asid % (nasid - 1) + 1;
+    asid_next = asid % (nasid - 1) + 1;
+
+    asid_pid[asid] = o->pid;
+    asid_gen[asid]++;
+    return o->asid = asid;
+}
 
-    /* Student's code ends here. */
+static void asid_flush(struct page_owner* o) {
+    if (o->asid && asid_pid[o->asid] == o->pid) asid_gen[o->asid]++;
+}
+
+/* In the user address space, a page not mapped by page_table_map has an
+ * invalid PTE, except the work directory of the shell, which is shared. */
+#define USER_VPAGE_PRIVATE(x)                                                  \
+    ((x) >= USER_VPAGE_BASE && (x) < USER_VPAGE_BASE + USER_VPAGE_CNT &&       \
+     (x) != SHELL_WORK_DIR / PAGE_SIZE)
+
+/* Page faults in the code, data, bss and heap region or in the stack region
+ * map zeroed pages on demand; see page_table_fault. */
+#define LAZY_VPAGE(x)                                                          \
+    (((x) >= APPS_ENTRY / PAGE_SIZE && (x) < APPS_ARG / PAGE_SIZE) ||          \
+     ((x) >= APPS_STACK_END / PAGE_SIZE && (x) < APPS_STACK_TOP / PAGE_SIZE))
+
+static uint identity_pte(uint vpage_no) {
+    return USER_VPAGE_PRIVATE(vpage_no) ? 0 : (vpage_no << 10) | USER_RWX;
+}
+
+static uint* pte_lookup(uint* root, uint vpage_no) {
+    /* The identity map has a leaf table for every user page. */
+    uint pte = root[vpage_no >> 10];
+    if (!(pte & 0x1)) FATAL("pte_lookup: no leaf table for 0x%x", vpage_no);
+    return &PTE_TO_ADDR(pte)[vpage_no & 0x3FF];
+}
+
+static void pte_set(int pid, uint vpage_no, uint pte) {
+    /* Set the PTE of vpage_no in the page table of pid. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    if (!o || !o->root) {
+        pagetable_identity_map(pid);
+        o = owner_lookup(pid, 0);
+    }
+
+    uint vpn1 = vpage_no >> 10;
+    if (o->root[vpn1] == kernel_root[vpn1]) {
+        /* Copy the leaf table shared with the kernel before changing it. */
+        uint ppage_id = earth->mmu_alloc();
+        uint* copy    = (void*)PAGE_ID_TO_ADDR(ppage_id);
+        page_own(ppage_id, pid);
+        for (uint i = 0; i < 1024; i++) copy[i] = identity_pte((vpn1 << 10) | i);
+        o->root[vpn1] = ((uint)copy >> 2) | 0x1;
+    }
+    *pte_lookup(o->root, vpage_no) = pte;
+    asid_flush(o);
+}
+
+static void page_table_set(int pid, uint vpage_no, uint paddr) {
+    pte_set(pid, vpage_no, (paddr >> 2) | USER_RWX);
+}
+
+static void page_table_set_rx(int pid, uint vpage_no, uint paddr) {
+    /* A store to a read-only page faults; see page_table_fault. */
+    pte_set(pid, vpage_no, (paddr >> 2) | USER_RX);
+}
+
+void page_table_map_file(int pid, uint vpage_no) {
+    /* Leave vpage_no unmapped, so that its first access faults and the page
+     * is loaded from the executable file; see page_table_fault. */
+    pte_set(pid, vpage_no, PTE_FILE);
+}
+
+static void page_table_unmap(int pid, uint ppage_id) {
+    /* Restore the identity map at the virtual page of ppage_id, unless the
+     * page is a page table (vpage_no 0) or the tables are being freed. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    uint vpage_no        = page_info_table[ppage_id].vpage_no;
+    if (o && o->root && vpage_no) {
+        *pte_lookup(o->root, vpage_no) = identity_pte(vpage_no);
+        asid_flush(o);
+    }
+}
+
+static void page_table_clone(int pid, int child) {
+    /* Copy the entries of the pages to be loaded from the executable file. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    for (uint v = USER_VPAGE_BASE; o && o->root && v < APPS_ARG / PAGE_SIZE;
+         v++)
+        if (*pte_lookup(o->root, v) == PTE_FILE) page_table_map_file(child, v);
+}
+
+static void page_table_free(int pid) {
+    /* Detach the page tables of pid before mmu_free frees its pages. */
+    struct page_owner* o = owner_lookup(pid, 0);
+    if (!o || !o->root) return;
+
+    if (o->asid && asid_pid[o->asid] == pid) {
+        asid_pid[o->asid] = 0;
+        asid_gen[o->asid]++;
+    }
+    o->root = NULL;
+}
+
+void page_table_map(int pid, uint vpage_no, uint ppage_id) {
+    page_own(ppage_id, pid);
+    page_info_table[ppage_id].vpage_no = vpage_no;
+    page_table_set(pid, vpage_no, (uint)PAGE_ID_TO_ADDR(ppage_id));
 }
 
 void page_table_switch(int pid) {
-    /* Student's code goes here (Virtual Memory). */
+    struct page_owner* o = owner_lookup(pid, 0);
+    if (!o || !o->root) FATAL("page_table_switch: no page table for %d", pid);
 
-    /* Remove the soft_tlb_switch below and, instead, update the page table
-     * base register (satp) using the value of pid_to_pagetable_base[pid].
-     * An example of updating the satp CSR is given in function mmu_init. */
-    soft_tlb_switch(pid);
+    uint core_id, asid = (nasid > 1) ? asid_alloc(o) : 0;
+    asm("csrr %0, mhartid" : "=r"(core_id));
+    asm("csrw satp, %0" ::"r"(SATP(o->root, asid)));
 
-    /* Student's code ends here. */
+    if (nasid <= 1) {
+        asm("sfence.vma zero,zero");
+    } else if (core_asid_gen[core_id][asid] != asid_gen[asid]) {
+        asm("sfence.vma zero,%0" ::"r"(asid));
+        core_asid_gen[core_id][asid] = asid_gen[asid];
+    }
 }
 
-uint page_table_translate(int pid, uint vaddr) {
-    /* Student's code goes here (Virtual Memory). */
+int page_table_fault(int pid, uint vaddr) {
+    /* Map a zeroed page at vaddr if the page fault is in a region which is
+     * mapped lazily, or copy the page on a write to a copy-on-write page, and
+     * return 0, or return 1 if the page is to be loaded from the executable
+     * file (PTE_FILE), or -1 for an invalid access. */
+    uint vpage_no        = vaddr / PAGE_SIZE;
+    struct page_owner* o = owner_lookup(pid, 0);
+    if (!USER_VPAGE_PRIVATE(vpage_no) || !o || !o->root) return -1;
+
+    uint pte = *pte_lookup(o->root, vpage_no);
+    if (pte & 0x1) {
+        int i = page_ref_lookup(pid, vpage_no);
+        if (i == NO_PAGE || !page_info_table[i].cow) return -1;
+        page_cow(pid, i, PAGE_ID_TO_ADDR(i));
+        return 0;
+    }
+    if (!LAZY_VPAGE(vpage_no)) return -1;
+    if (pte & PTE_FILE) return 1;
 
-    /* Remove the following line of code. Walk through the page tables
-     * for process pid and return the physical address mapped from vaddr. */
-    return soft_tlb_translate(pid, vaddr);
+    uint ppage_id = mmu_alloc();
+    memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
+    page_table_map(pid, vpage_no, ppage_id);
+    return 0;
+}
 
-    /* Student's code ends here. */
+uint page_table_translate(int pid, uint vaddr) {
+    struct page_owner* o = owner_lookup(pid, 0);
+    if (!o || !o->root) FATAL("page_table_translate: no table for %d", pid);
+
+    uint pte = *pte_lookup(o->root, vaddr / PAGE_SIZE);
+    return (uint)PTE_TO_ADDR(pte) | (vaddr & (PAGE_SIZE - 1));
 }
 
 void flush_cache() {
@@ -180,18 +703,26 @@ void flush_cache() {
          */
         asm(".word(0x100F)\nnop\nnop\nnop\nnop\nnop\n");
     }
-    if (earth->translation == PAGE_TABLE) {
-        /* Flush the TLB, the cache for page table entries. */
-        /* See
-         * https://riscv.org/wp-content/uploads/2017/05/riscv-privileged-v1.10.pdf#subsection.4.2.1
-         */
-        asm("sfence.vma zero,zero");
-    }
+    /* With page tables, page_table_switch flushes the stale TLB entries. */
 }
 
 void mmu_init() {
+    /* Put all the pages in the free list. */
+    for (uint i = 0; i < APPS_PAGES_CNT; i++)
+        page_info_table[i].next[0] = (i + 1 < APPS_PAGES_CNT) ? i + 1 : NO_PAGE;
+    free_head = 0;
+    for (uint v = 0; v < USER_VPAGE_CNT; v++) resident[v] = NO_PAGE;
+    for (uint r = 0; r < PAGE_REF_CNT; r++)
+        page_ref_table[r].next = (r + 1 < PAGE_REF_CNT) ? r + 1 : NO_PAGE;
+    ref_free_head = 0;
+
     earth->mmu_free        = mmu_free;
     earth->mmu_alloc       = mmu_alloc;
+    earth->mmu_share       = mmu_share;
+    earth->mmu_unmap       = mmu_unmap;
+    earth->mmu_exchange    = mmu_exchange;
+    earth->mmu_map_shared  = mmu_map_shared;
+    earth->mmu_clone       = mmu_clone;
     earth->mmu_flush_cache = flush_cache;
 
     /* Setup a PMP region for the whole 4GB address space. */
@@ -217,11 +748,20 @@ void mmu_init() {
     if (earth->translation == PAGE_TABLE) {
         /* Setup an identity map using page tables. */
         pagetable_identity_map(0);
-        asm("csrw satp, %0" ::"r"(((uint)root >> 12) | (1 << 31)));
+
+        /* Find the number of ASIDs from the ASID bits which stick in satp. */
+        uint satp;
+        asm("csrw satp, %0" ::"r"(SATP(root, MAX_NASID - 1)));
+        asm("csrr %0, satp" : "=r"(satp));
+        nasid = ((satp >> 22) & (MAX_NASID - 1)) + 1;
+        asm("csrw satp, %0" ::"r"(SATP(root, 0)));
+        INFO("Page tables use %d ASIDs", nasid);
 
         earth->mmu_map       = page_table_map;
         earth->mmu_switch    = page_table_switch;
         earth->mmu_translate = page_table_translate;
+        earth->mmu_fault     = page_table_fault;
+        earth->mmu_map_file  = page_table_map_file;
     } else {
         earth->mmu_map       = soft_tlb_map;
         earth->mmu_switch    = soft_tlb_switch;
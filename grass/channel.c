@@ -0,0 +1,86 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: shared-memory ring channels
+ * A channel is a page mapped at CHANNEL_ADDR(chan) by both of its ends, a
+ * process and a server, plus a pending doorbell bit for each end; see
+ * struct chan_ring in library/syscall/syscall.h for the ring in the page.
+ */
+
+#include "process.h"
+#include <string.h>
+
+#define PAGE_ID_TO_ADDR(x) ((char*)APPS_PAGES_BASE + x * PAGE_SIZE)
+
+struct channel {
+    int end[2]; /* pids of the two ends, or 0 if the channel is unused */
+    uint ppage_id;
+    uchar bell[2]; /* a doorbell is pending for end[i] */
+} channels[NCHANNELS];
+
+int channel_open(int pid, int peer) {
+    if (pid == peer || !proc_lookup(pid) || !proc_lookup(peer)) return -1;
+
+    for (uint i = 0; i < NCHANNELS; i++)
+        if (!channels[i].end[0]) {
+            uint ppage_id = earth->mmu_alloc();
+            memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
+            earth->mmu_map(pid, CHANNEL_ADDR(i) / PAGE_SIZE, ppage_id);
+            earth->mmu_share(peer, ppage_id);
+            channels[i] = (struct channel){{pid, peer}, ppage_id, {0, 0}};
+            return i;
+        }
+    return -1;
+}
+
+int channel_lookup(int pid, int peer) {
+    for (uint i = 0; i < NCHANNELS; i++)
+        if ((channels[i].end[0] == pid && channels[i].end[1] == peer) ||
+            (channels[i].end[0] == peer && channels[i].end[1] == pid))
+            return i;
+    return -1;
+}
+
+void channel_close(int pid) {
+    /* Unmap every channel of pid from both of its ends. */
+    for (uint i = 0; i < NCHANNELS; i++)
+        if (channels[i].end[0] == pid || channels[i].end[1] == pid) {
+            earth->mmu_unmap(channels[i].end[0], channels[i].ppage_id);
+            earth->mmu_unmap(channels[i].end[1], channels[i].ppage_id);
+            memset(&channels[i], 0, sizeof(struct channel));
+        }
+}
+
+int channel_peer(uint chan, int pid) {
+    /* Return the other end of chan, or 0 if pid is not an end of chan. */
+    if (chan >= NCHANNELS || !pid) return 0;
+    if (channels[chan].end[0] == pid) return channels[chan].end[1];
+    if (channels[chan].end[1] == pid) return channels[chan].end[0];
+    return 0;
+}
+
+void channel_ring(uint chan, int pid) {
+    channels[chan].bell[channels[chan].end[1] == pid] = 1;
+}
+
+int channel_take_bell(int pid, int from) {
+    /* Clear a doorbell pending for pid from an accepted sender, and return
+     * the sender, or 0 if there is no such doorbell. */
+    for (uint i = 0; i < NCHANNELS; i++)
+        for (uint e = 0; e < 2; e++)
+            if (channels[i].bell[e] && channels[i].end[e] == pid &&
+                (from == GPID_ALL || from == channels[i].end[1 - e])) {
+                channels[i].bell[e] = 0;
+                return channels[i].end[1 - e];
+            }
+    return 0;
+}
+
+int channel_take_bell_of(uint chan, int pid) {
+    /* Clear the doorbell pending for pid on chan; return whether it was. */
+    uchar* bell = &channels[chan].bell[channels[chan].end[1] == pid];
+    int rung    = *bell;
+    *bell       = 0;
+    return rung;
+}
@@ -9,6 +9,8 @@
 #include "process.h"
 #include "elf.h"
 
+extern struct process proc_set[PROC_SET_SIZE];
+
 static void sys_proc_read(uint block_no, char* dst) {
     earth->disk_read(SYS_PROC_EXEC_START + block_no, 1, dst);
 }
@@ -17,22 +19,46 @@ void grass_entry(uint core_id) {
     SUCCESS("Enter the grass layer");
 
     /* Initialize the grass interface. */
-    grass->proc_free      = proc_free;
-    grass->proc_alloc     = proc_alloc;
-    grass->proc_set_ready = proc_set_ready;
-    grass->sys_send       = sys_send;
-    grass->sys_recv       = sys_recv;
+    grass->proc_free           = proc_free;
+    grass->proc_alloc          = proc_alloc;
+    grass->proc_set_ready      = proc_set_ready;
+    grass->proc_clone          = proc_clone;
+    grass->sys_send            = sys_send;
+    grass->sys_send_page       = sys_send_page;
+    grass->sys_recv            = sys_recv;
+    grass->sys_call            = sys_call;
+    grass->sys_reply_recv      = sys_reply_recv;
+    grass->sys_reply_recv_page = sys_reply_recv_page;
     /* Student's code goes here (System Call | Multicore & Locks). */
 
     /* Initialize the grass interface for proc_sleep() or proc_coresinfo(). */
+    grass->proc_set_tickets = proc_set_tickets;
+    grass->proc_coresinfo   = proc_coresinfo;
+    grass->sched_trace      = trace_drain;
+    grass->channel_open     = channel_open;
+    grass->channel_lookup   = channel_lookup;
+
+    /* Choose the scheduling policy at boot, as mmu_init() does for the
+     * translation; any other key takes the default, SCHED in Makefile. */
+    struct sched_ops* policy[] = {&mlfq_ops, &stride_ops};
+    CRITICAL("Choose a scheduling policy:");
+    printf("Enter 0: MLFQ\n\rEnter 1: stride\n\rEnter other keys: %s\n\r",
+           policy[SCHED]->name);
+
+    char c;
+    earth->tty_read(&c);
+    sched = (c == '0' || c == '1') ? policy[c - '0'] : policy[SCHED];
+    INFO("Use the %s scheduling policy", sched->name);
 
     /* Student's code ends here. */
 
     /* Load GPID_PROCESS. */
     INFO("Load kernel process #%d: sys_process", GPID_PROCESS);
-    elf_load(GPID_PROCESS, sys_proc_read, 0, 0);
+    elf_load(GPID_PROCESS, sys_proc_read, NULL, 0, 0, NULL);
     proc_set_running(proc_alloc());
     core_to_proc_idx[core_id] = 1; /* See proc_alloc() for why. */
+    /* trap_entry saves the registers of pid 1 in place; see kernel.s. */
+    asm("csrw mscratch, %0" ::"r"(proc_set[1].saved_registers));
     earth->mmu_switch(GPID_PROCESS);
     earth->mmu_flush_cache();
 
@@ -12,8 +12,8 @@
 
 uint core_in_kernel;
 uint core_to_proc_idx[NCORES];
-struct process proc_set[MAX_NPROCESS + 1];
-/* proc_set[0] is a place holder for idle cores. */
+struct process proc_set[PROC_SET_SIZE];
+ulonglong core_idle_time[NCORES], core_idle_start[NCORES];
 
 #define curr_proc_idx core_to_proc_idx[core_in_kernel]
 #define curr_pid      proc_set[curr_proc_idx].pid
@@ -23,43 +23,97 @@ struct process proc_set[MAX_NPROCESS + 1];
 static void intr_entry(uint);
 static void excp_entry(uint);
 
-void kernel_entry() {
+uint* kernel_entry() {
     /* With the kernel lock, only one core can enter this point at any time. */
     asm("csrr %0, mhartid" : "=r"(core_in_kernel));
 
-    /* Save the process context. */
+    /* Save the process context; trap_entry has saved the registers in
+     * curr_saved already, since mscratch points to it. */
     asm("csrr %0, mepc" : "=r"(proc_set[curr_proc_idx].mepc));
-    memcpy(curr_saved, SAVED_REGISTER_ADDR, SAVED_REGISTER_SIZE);
 
     uint mcause;
     asm("csrr %0, mcause" : "=r"(mcause));
     (mcause & (1 << 31)) ? intr_entry(mcause & 0x3FF) : excp_entry(mcause);
 
-    /* Restore the process context. */
+    /* Restore the process context; trap_entry restores the registers from
+     * the returned curr_saved and points mscratch to it. */
     asm("csrw mepc, %0" ::"r"(proc_set[curr_proc_idx].mepc));
-    memcpy(SAVED_REGISTER_ADDR, curr_saved, SAVED_REGISTER_SIZE);
+    return curr_saved;
 }
 
-#define INTR_ID_TIMER   7
-#define EXCP_ID_ECALL_U 8
-#define EXCP_ID_ECALL_M 11
+#define INTR_ID_TIMER    7
+#define EXCP_ID_ECALL_U  8
+#define EXCP_ID_ECALL_M  11
+#define EXCP_ID_INSTR_PF 12
+#define EXCP_ID_LOAD_PF  13
+#define EXCP_ID_STORE_PF 15
 static void proc_yield();
-static void proc_try_syscall(struct process* proc);
+static void proc_switch(struct process* next, int new_slice);
+static struct process* proc_try_syscall(struct process* proc);
+
+static void proc_syscall(struct process* p) {
+    /* Block p on its system call in p->syscall. If a peer has taken the
+     * message of SYS_CALL, SYS_REPLY_RECV or SYS_FAULT, switch straight to
+     * the peer without running the scheduler. The peer only gets the rest
+     * of the slice of p, so that a client and a server calling each other
+     * cannot keep the other processes off the core, and the timer still
+     * fires at the next wakeup, since every sleeper armed it on its way to
+     * sleep. */
+    p->syscall.status = PENDING;
+    sched->on_block(p, mtime_get() - p->latest_running_start_time);
+    proc_set_pending(p->pid);
+    proc_wakeup();
+
+    struct process* peer = proc_try_syscall(p);
+    peer ? proc_switch(peer, 0) : proc_yield();
+}
 
 static void excp_entry(uint id) {
     if (id >= EXCP_ID_ECALL_U && id <= EXCP_ID_ECALL_M) {
-        /* Copy the system call arguments from user space to the kernel. */
-        uint syscall_paddr = earth->mmu_translate(curr_pid, SYSCALL_ARG);
-        memcpy(&proc_set[curr_proc_idx].syscall, (void*)syscall_paddr,
-               sizeof(struct syscall));
-        proc_set[curr_proc_idx].syscall.status = PENDING;
-
-        proc_set_pending(curr_pid);
-        proc_set[curr_proc_idx].mepc += 4;
-        proc_try_syscall(&proc_set[curr_proc_idx]);
-        proc_yield();
+        /* Copy the system call arguments from user space to the kernel:
+         * the header, and only the used part of the message for SYS_SEND. */
+        struct process* p  = &proc_set[curr_proc_idx];
+        struct syscall* sc = (void*)earth->mmu_translate(curr_pid, SYSCALL_ARG);
+        memcpy(&p->syscall, sc, SYSCALL_HDR_LEN);
+        if (IS_SEND(p->syscall.type)) {
+            if (p->syscall.len > SYSCALL_MSG_LEN)
+                p->syscall.len = SYSCALL_MSG_LEN;
+            memcpy(p->syscall.content, sc->content, p->syscall.len);
+        }
+        p->mepc += 4;
+        proc_syscall(p);
         return;
     }
+
+    if (id == EXCP_ID_INSTR_PF || id == EXCP_ID_LOAD_PF ||
+        id == EXCP_ID_STORE_PF) {
+        /* Map a page on demand and retry the faulting instruction; switching
+         * to curr_pid again flushes the stale TLB entries of the page. */
+        uint vaddr;
+        asm("csrr %0, mtval" : "=r"(vaddr));
+        int r = (earth->translation == PAGE_TABLE)
+                    ? earth->mmu_fault(curr_pid, vaddr)
+                    : -1;
+        if (r == 0) {
+            earth->mmu_switch(curr_pid);
+            return;
+        }
+        if (r > 0) {
+            /* Ask GPID_PROCESS to load the page from the executable file,
+             * and retry the instruction when it replies; see elf_fault. */
+            struct process* p        = &proc_set[curr_proc_idx];
+            struct proc_request* req = (void*)p->syscall.content;
+            p->syscall.type          = SYS_FAULT;
+            p->syscall.receiver      = GPID_PROCESS;
+            p->syscall.len           = offsetof(struct proc_request, argv);
+            p->syscall.send_page     = 0;
+            p->syscall.recv_page     = 0;
+            req->type                = PROC_FAULT;
+            req->vaddr               = vaddr;
+            proc_syscall(p);
+            return;
+        }
+    }
     /* Student's code goes here (System Call & Protection | Virtual Memory). */
 
     /* Kill the current process if curr_pid is a user application. */
@@ -88,70 +142,65 @@ static void intr_entry(uint id) {
         p->t_cpu += running_time_on_cpu;
         p->num_interrupts++;
 
-        if (p->pid >= GPID_USER_START) {
-            my_printf("[INTR timer interrupt | pid = %d | ran = %d | t_cpu = %d\n", (int)p->pid, (int)running_time_on_cpu, (int)p->t_cpu);
-        }
+        if (p->pid >= GPID_USER_START)
+            trace_record(EV_INTR, p, running_time_on_cpu);
 
-        mlfq_update_level(p, running_time_on_cpu);
+        sched->on_tick(p, running_time_on_cpu);
     }
 
     /* Student's code ends here. */
     proc_yield();
 }
 
-static void proc_yield() {
-    if (curr_status == PROC_RUNNING) proc_set_runnable(curr_pid);
-
-    /* Student's code goes here (Multiple Projects). */
-
-    mlfq_reset_level(); // Calling reset level everytime the scheduler is invoked to check for starvation and pending keyboard inputs
-    int next_idx = -1;
-    bool is_found = false;
-
-    for (int lvl = 0; lvl < MLFQ_NLEVELS && !is_found; lvl++) {
-        for (uint i = 1; i <= MAX_NPROCESS; i++) {
-            int idx = (curr_proc_idx + i) % MAX_NPROCESS;
-            struct process* p = &proc_set[idx];
-
-            if (p->status == PROC_PENDING_SYSCALL) // Trying to unblock pending syscalls 
-                proc_try_syscall(p);
-
-            if (p->status == PROC_SLEEPING) { // Checking if any sleeping processes can be woken up (Although this will never happen since sleep syscall is not handled, but adding this code here just because the comments said to do so)
-                ulonglong now = mtime_get();
-                if (now >= p->wake_time) {
-                    p->status = PROC_RUNNABLE;
-                } else {
-                    continue;
-                }
-            }
+static void proc_idle() {
+    while (1) asm("wfi");
+}
 
-            if (p->status != PROC_READY && p->status != PROC_RUNNABLE) // Skipping anything not runnable
-                continue;
+static void mret_mode(uint mode) {
+    /* Set the privilege mode that the next mret returns to. */
+    uint mstatus;
+    asm("csrr %0, mstatus" : "=r"(mstatus));
+    asm("csrw mstatus, %0" ::"r"((mstatus & ~(3 << 11)) | (mode << 11)));
+}
 
-            if (p->pid < GPID_USER_START) { // Scheduling Kernel process first, no matter their level
-                next_idx = idx;
-                is_found = true;
-                break;
-            }
+#define M_MODE     3
+#define U_MODE     0
+#define GRASS_MODE (earth->translation == SOFT_TLB ? M_MODE : U_MODE)
+#define SAVED_SP   30 /* index of sp in saved_registers; see kernel.s */
 
-            if (p->level == lvl) { // Finding the first process for this level's queue
-                next_idx = idx;
-                is_found = true;
-                break;
-            }
-        }
-    }
+static void proc_yield() {
+    if (curr_status == PROC_RUNNING) proc_set_runnable(curr_pid);
+    if (curr_proc_idx == IDLE_PROC_IDX(core_in_kernel))
+        core_idle_time[core_in_kernel] +=
+            mtime_get() - core_idle_start[core_in_kernel];
 
-    if (!is_found)
-        FATAL("proc_yield: no runnable process");
+    /* Student's code goes here (Multiple Projects). */
 
-    if (proc_set[next_idx].pid >= GPID_USER_START || curr_pid >= GPID_USER_START) {
-        my_printf("[SCHED] Switching from pid = %d ==> pid = %d (in level = %d)\n", (int)curr_pid, (int)proc_set[next_idx].pid, (int)proc_set[next_idx].level);
+    struct process* next = proc_next();
+    if (next == NULL) {
+        /* Park this core in proc_idle() (machine mode, interrupts enabled)
+         * on its own idle context until the next wakeup, if any. A core
+         * making a process ready wakes this core up earlier through its
+         * timer; see proc_wake_idle_core in process.c. */
+        static uint idle_stack[NCORES][64];
+        curr_proc_idx                   = IDLE_PROC_IDX(core_in_kernel);
+        curr_saved[SAVED_SP]            = (uint)&idle_stack[core_in_kernel][64];
+        proc_set[curr_proc_idx].mepc    = (uint)proc_idle;
+        core_idle_start[core_in_kernel] = mtime_get();
+        mret_mode(M_MODE);
+        earth->timer_reset(core_in_kernel, 0, proc_next_wakeup());
+        return;
     }
 
     /* Student's code ends here. */
+    proc_switch(next, 1);
+}
 
-    curr_proc_idx = next_idx;
+static void proc_switch(struct process* next, int new_slice) {
+    if (next->pid >= GPID_USER_START || curr_pid >= GPID_USER_START)
+        trace_record(EV_SCHED, next, 0);
+
+    curr_proc_idx = next - proc_set;
     earth->mmu_switch(curr_pid);
     earth->mmu_flush_cache();
     if (curr_status == PROC_READY) {
@@ -161,53 +210,214 @@ static void proc_yield() {
         proc_set[curr_proc_idx].mepc = APPS_ENTRY;
     }
     proc_set_running(curr_pid);
-    earth->timer_reset(core_in_kernel);
-}
-
-static void proc_try_send(struct process* sender) {
-    for (uint i = 0; i < MAX_NPROCESS; i++) {
-        struct process* dst = &proc_set[i];
-        if (dst->pid == sender->syscall.receiver &&
-            dst->status != PROC_UNUSED) {
-            /* Return if dst is not receiving or not taking msg from sender. */
-            if (!(dst->syscall.type == SYS_RECV &&
-                  dst->syscall.status == PENDING))
-                return;
-            if (!(dst->syscall.sender == GPID_ALL ||
-                  dst->syscall.sender == sender->pid))
-                return;
-
-            dst->syscall.status = DONE;
-            dst->syscall.sender = sender->pid;
-            /* Copy the system call arguments within the kernel PCB. */
-            memcpy(dst->syscall.content, sender->syscall.content,
-                   SYSCALL_MSG_LEN);
-            return;
-        }
+    mret_mode(GRASS_MODE);
+    if (new_slice)
+        earth->timer_reset(core_in_kernel,
+                           sched->slice(&proc_set[curr_proc_idx]),
+                           proc_next_wakeup());
+}
+
+/* A blocked system call is only retried when its peer makes a matching call:
+ * a sender waits on the senders queue of its receiver until the receiver
+ * calls sys_recv, and a receiver waits (on no queue) until a sender calls
+ * sys_send, so the scheduler never polls PROC_PENDING_SYSCALL processes.
+ * SYS_CALL and SYS_REPLY_RECV turn into SYS_RECV once their message is
+ * delivered. A SYS_SEND message goes to the mailbox of the receiver if the
+ * receiver is not receiving, and the sender only blocks if it is full.
+ * A SYS_DOORBELL is delivered as an empty message, or ends the SYS_BELL_WAIT
+ * of the peer on the channel, or is left pending in the channel until the
+ * peer receives or waits for it. */
+static void proc_try_recv(struct process* receiver);
+
+static int proc_accepts(struct process* receiver, int sender) {
+    return receiver->syscall.sender == GPID_ALL ||
+           receiver->syscall.sender == sender;
+}
+
+static void proc_copy_msg(struct process* dst, int sender, char* msg,
+                          uint len, uint page) {
+    dst->syscall.status    = DONE;
+    dst->syscall.sender    = sender;
+    dst->syscall.len       = len;
+    dst->syscall.recv_page = page;
+
+    /* Copy the system call header and the message straight from the kernel
+     * to the user space of the receiver, which a page fault leaves alone. */
+    if (dst->syscall.type != SYS_FAULT_WAIT) {
+        struct syscall* sc = (void*)earth->mmu_translate(dst->pid, SYSCALL_ARG);
+        memcpy(sc, &dst->syscall, SYSCALL_HDR_LEN);
+        memcpy(sc->content, msg, len);
+    }
+
+    /* Set the receiver back to RUNNABLE. */
+    proc_set_runnable(dst->pid);
+}
+
+static void proc_send_done(struct process* sender) {
+    /* Set the sender back to RUNNABLE unless it still waits for a reply or
+     * for the next request. */
+    if (sender->syscall.type == SYS_SEND) {
+        proc_set_runnable(sender->pid);
+        return;
+    }
+    if (sender->syscall.type == SYS_CALL || sender->syscall.type == SYS_FAULT) {
+        sender->syscall.type   = (sender->syscall.type == SYS_CALL)
+                                     ? SYS_CALL_WAIT
+                                     : SYS_FAULT_WAIT;
+        sender->syscall.sender = sender->syscall.receiver;
+    } else {
+        sender->syscall.type = SYS_RECV;
+    }
+    proc_try_recv(sender);
+}
+
+static uint proc_move_page(struct process* sender, struct process* dst) {
+    /* Remap the page of the sender at send_page to recv_page of dst, in
+     * exchange for the page of dst there; return recv_page if the page is
+     * moved, or 0 if either side does not ask for it or it cannot move. */
+    uint from = sender->syscall.send_page, to = dst->syscall.recv_page;
+    if (!from || !to || from % PAGE_SIZE || to % PAGE_SIZE) return 0;
+    if (from == SYSCALL_ARG || to == SYSCALL_ARG) return 0;
+    return earth->mmu_exchange(sender->pid, from / PAGE_SIZE, dst->pid,
+                               to / PAGE_SIZE) == 0 ? to : 0;
+}
+
+static int mailbox_put(struct mailbox* mb, struct process* sender) {
+    if (mb->count == MAILBOX_NSLOTS) return 0;
+
+    uint i = __builtin_ctz(~mb->used);
+    mb->used |= 1 << i;
+    mb->order[mb->count++] = i;
+    mb->slot[i].sender     = sender->pid;
+    mb->slot[i].len        = sender->syscall.len;
+    memcpy(mb->slot[i].content, sender->syscall.content, sender->syscall.len);
+    return 1;
+}
+
+static void mailbox_remove(struct mailbox* mb, uint pos) {
+    mb->used &= ~(1 << mb->order[pos]);
+    for (mb->count--; pos < mb->count; pos++)
+        mb->order[pos] = mb->order[pos + 1];
+}
+
+static struct process* proc_try_send(struct process* sender) {
+    struct process* dst = proc_lookup(sender->syscall.receiver);
+    if (dst == NULL) {
+        proc_ipc_fail(sender);
+        return NULL;
+    }
+
+    if (IS_RECV(dst->syscall.type) && dst->syscall.status == PENDING &&
+        proc_accepts(dst, sender->pid)) {
+        proc_copy_msg(dst, sender->pid, sender->syscall.content,
+                      sender->syscall.len, proc_move_page(sender, dst));
+        proc_send_done(sender);
+        return dst;
+    }
+
+    /* Block sender if dst is not receiving or not taking msg from sender,
+     * unless a SYS_SEND message without a page fits in the mailbox of dst. */
+    if (sender->syscall.type == SYS_SEND && !sender->syscall.send_page &&
+        mailbox_put(&dst->mailbox, sender))
+        proc_set_runnable(sender->pid);
+    else
+        proc_queue_push(&dst->senders, sender);
+    return NULL;
+}
+
+static void proc_doorbell(struct process* p) {
+    int peer = channel_peer(p->syscall.receiver, p->pid);
+    if (!peer) return;
+
+    struct process* dst = proc_lookup(peer);
+    if (dst->syscall.type == SYS_RECV && dst->syscall.status == PENDING &&
+        proc_accepts(dst, p->pid))
+        proc_copy_msg(dst, p->pid, NULL, 0, 0);
+    else if (dst->syscall.type == SYS_BELL_WAIT &&
+             dst->syscall.status == PENDING &&
+             dst->syscall.receiver == p->syscall.receiver) {
+        dst->syscall.status = DONE;
+        proc_set_runnable(peer);
+    } else
+        channel_ring(p->syscall.receiver, peer);
+}
+
+static void proc_bell_wait(struct process* p) {
+    /* Take the doorbell if it has rung already, or if it never will. */
+    uint chan = p->syscall.receiver;
+    if (!channel_peer(chan, p->pid) || channel_take_bell_of(chan, p->pid)) {
+        p->syscall.status = DONE;
+        proc_set_runnable(p->pid);
     }
-    FATAL("proc_try_send: unknown receiver pid=%d", sender->syscall.receiver);
 }
 
 static void proc_try_recv(struct process* receiver) {
-    if (receiver->syscall.status == PENDING) return;
+    /* Take a pending doorbell first, unless waiting for a SYS_CALL reply. */
+    int ringer;
+    if (receiver->syscall.type == SYS_RECV &&
+        (ringer = channel_take_bell(receiver->pid, receiver->syscall.sender))) {
+        proc_copy_msg(receiver, ringer, NULL, 0, 0);
+        return;
+    }
+
+    /* Take the oldest message in the mailbox that the receiver accepts, and
+     * move the message of the first blocked SYS_SEND into the free slot. */
+    struct mailbox* mb = &receiver->mailbox;
+    for (uint i = 0; i < mb->count; i++) {
+        struct mailbox_msg* m = &mb->slot[mb->order[i]];
+        if (!proc_accepts(receiver, m->sender)) continue;
+
+        proc_copy_msg(receiver, m->sender, m->content, m->len, 0);
+        mailbox_remove(mb, i);
+        for (struct process* p = receiver->senders.head; p; p = p->next)
+            if (p->syscall.type == SYS_SEND && !p->syscall.send_page) {
+                proc_queue_remove(&receiver->senders, p);
+                mailbox_put(mb, p);
+                proc_set_runnable(p->pid);
+                break;
+            }
+        return;
+    }
 
-    /* Copy the system call struct from the kernel back to user space. */
-    uint syscall_paddr = earth->mmu_translate(receiver->pid, SYSCALL_ARG);
-    memcpy((void*)syscall_paddr, &receiver->syscall, sizeof(struct syscall));
+    /* Otherwise, take the first blocked sender that the receiver accepts. */
+    for (struct process* p = receiver->senders.head; p; p = p->next)
+        if (proc_accepts(receiver, p->pid)) {
+            proc_queue_remove(&receiver->senders, p);
+            proc_copy_msg(receiver, p->pid, p->syscall.content,
+                          p->syscall.len, proc_move_page(p, receiver));
+            proc_send_done(p);
+            return;
+        }
 
-    /* Set the receiver and sender back to RUNNABLE. */
-    proc_set_runnable(receiver->pid);
-    proc_set_runnable(receiver->syscall.sender);
+    /* Fail a receive from a process which does not exist. */
+    if (receiver->syscall.sender != GPID_ALL &&
+        !proc_lookup(receiver->syscall.sender))
+        proc_ipc_fail(receiver);
 }
 
-static void proc_try_syscall(struct process* proc) {
+static struct process* proc_try_syscall(struct process* proc) {
     switch (proc->syscall.type) {
     case SYS_RECV:
         proc_try_recv(proc);
-        break;
+        return NULL;
     case SYS_SEND:
         proc_try_send(proc);
-        break;
+        return NULL;
+    case SYS_CALL:
+    case SYS_REPLY_RECV:
+    case SYS_FAULT:
+        /* Return the peer that has taken the message, if any. */
+        return proc_try_send(proc);
+    case SYS_DOORBELL:
+        proc_doorbell(proc);
+        proc_set_runnable(proc->pid);
+        return NULL;
+    case SYS_BELL_WAIT:
+        proc_bell_wait(proc);
+        return NULL;
+    case SYS_SLEEP:
+        proc_sleep(proc->pid, proc->syscall.len);
+        return NULL;
     default:
         FATAL("proc_try_syscall: unknown syscall type=%d", proc->syscall.type);
     }
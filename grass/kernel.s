@@ -11,10 +11,11 @@
 
 trap_entry:
     /* Step1: Acquire the kernel lock (only for multicore).
-     * Step2: Switch to the kernel stack.
-     * Step3: Save all the registers on the kernel stack.
-     * Step4: Call kernel_entry().
-     * Step5: Restore all the registers.
+     * Step2: Point sp to the register save area of the current process.
+     * Step3: Save all the registers in place and switch to the kernel stack.
+     * Step4: Call kernel_entry(), which returns the register save area of
+     *        the next process.
+     * Step5: Restore all the registers from that save area.
      * Step6: Switch back to the process stack.
      * Step7: Release the kernel lock (only for multicore).
      * Step8: Invoke mret, returning to the process context. */
@@ -27,11 +28,9 @@ trap_entry:
     /* Student's code ends here. */
 
     /* Step2 */
-    csrw mscratch, sp
-    li sp, 0x80200000
+    csrrw sp, mscratch, sp /* mscratch holds saved_registers of the process */
 
     /* Step3 */
-    addi sp, sp, -128 /* now, sp == SAVED_REGISTER_ADDR */
     sw a0,  0(sp)
     sw a1,  4(sp)
     sw a2,  8(sp)
@@ -62,13 +61,16 @@ trap_entry:
     sw ra,  108(sp)
     sw gp,  112(sp)
     sw tp,  116(sp)
-    csrr t0, mscratch /* Step1 has written sp to mscratch */
+    csrr t0, mscratch /* Step2 has written sp to mscratch */
     sw t0,  120(sp)   /* t0 holds the value of the old sp before trap_entry */
+    li sp, 0x80200000 /* the kernel stack */
 
     /* Step4 */
     call kernel_entry
 
     /* Step5 */
+    mv sp, a0
+    csrw mscratch, a0 /* save area of the next trap on this core */
     lw a0,  0(sp)
     lw a1,  4(sp)
     lw a2,  8(sp)
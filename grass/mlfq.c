@@ -0,0 +1,139 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: the multi-level feedback queue (MLFQ) scheduling policy
+ */
+
+#include "process.h"
+
+#define MLFQ_RESET_PERIOD     10000000         /* 10 seconds */
+#define MLFQ_LEVEL_RUNTIME(x) (x + 1) * 100000 /* e.g., 100ms for level 0 */
+#define MLFQ_LEVEL_QUANTA(x)  (x + 1)          /* timer quanta per slice   */
+
+/* Ready processes wait in one FIFO per MLFQ level; bit x of mlfq_nonempty
+ * is set iff mlfq_ready[x] is not empty, so the scheduler finds the highest
+ * nonempty level with a single find-first-set. */
+static struct proc_queue mlfq_ready[MLFQ_NLEVELS];
+static uint mlfq_nonempty;
+static uint mlfq_epoch; /* incremented by every periodic priority boost */
+
+static void proc_queue_splice(struct proc_queue* dst, struct proc_queue* src) {
+    if (!src->head) return;
+    if (dst->tail) dst->tail->next = src->head;
+    else dst->head = src->head;
+    src->head->prev = dst->tail;
+    dst->tail       = src->tail;
+    src->head = src->tail = NULL;
+}
+
+/* Return the queue index of p, applying a pending periodic boost lazily. */
+static int mlfq_level(struct process* p) {
+    if (p->mlfq_epoch != mlfq_epoch) {
+        p->mlfq_epoch  = mlfq_epoch;
+        p->level       = 0;
+        p->t_remaining = MLFQ_LEVEL_RUNTIME(0);
+    }
+    /* Kernel processes are always scheduled before user processes. */
+    return p->pid < GPID_USER_START ? 0 : p->level;
+}
+
+static void mlfq_init(struct process* p) {
+    p->level       = 0;
+    p->t_remaining = MLFQ_LEVEL_RUNTIME(0);
+    p->mlfq_epoch  = mlfq_epoch;
+}
+
+static void mlfq_enqueue(struct process* p) {
+    int lvl = mlfq_level(p);
+    proc_queue_push(&mlfq_ready[lvl], p);
+    mlfq_nonempty |= (1 << lvl);
+}
+
+static void mlfq_dequeue(struct process* p) {
+    int lvl = mlfq_level(p);
+    proc_queue_remove(&mlfq_ready[lvl], p);
+    if (!mlfq_ready[lvl].head) mlfq_nonempty &= ~(1 << lvl);
+}
+
+static uint mlfq_slice(struct process* p) {
+    /* Lower levels run for longer slices with fewer context switches. */
+    return MLFQ_LEVEL_QUANTA(mlfq_level(p));
+}
+
+static struct process* mlfq_pick() {
+    mlfq_reset_level(); // Calling reset level everytime the scheduler is invoked to check for starvation and pending keyboard inputs
+
+    /* Pick the head of the highest nonempty MLFQ ready queue. */
+    if (!mlfq_nonempty) return NULL;
+    return mlfq_ready[__builtin_ctz(mlfq_nonempty)].head;
+}
+
+/* A process blocking before its slice ends keeps its remaining budget. */
+static void mlfq_on_block(struct process* p, ulonglong runtime) {}
+
+struct sched_ops mlfq_ops = {.name      = "MLFQ",
+                             .init      = mlfq_init,
+                             .enqueue   = mlfq_enqueue,
+                             .dequeue   = mlfq_dequeue,
+                             .pick_next = mlfq_pick,
+                             .on_tick   = mlfq_update_level,
+                             .on_block  = mlfq_on_block,
+                             .slice     = mlfq_slice};
+
+void mlfq_update_level(struct process* p, ulonglong runtime) {
+    /* Student's code goes here (Preemptive Scheduler). */
+
+    /* Update the MLFQ-related fields in struct process* p after this
+     * process has run on the CPU for another runtime microseconds. */
+
+    if (p == NULL) return;
+    mlfq_level(p);
+
+    if (runtime >= p->t_remaining) {
+        if (p->level < MLFQ_NLEVELS - 1) {
+            p->level++;
+        }
+        p->t_remaining = MLFQ_LEVEL_RUNTIME(p->level);
+    } else {
+        p->t_remaining -= runtime;
+    }
+
+    if (p->pid >= GPID_USER_START) trace_record(EV_MLFQ, p, runtime);
+
+    /* Student's code ends here. */
+}
+
+void mlfq_reset_level() {
+    /* Student's code goes here (Preemptive Scheduler). */
+    
+    static ulonglong MLFQ_last_reset_time = 0;
+    ulonglong current_time = mtime_get();
+    
+    /* Reset the level of GPID_SHELL if there is pending keyboard input. */
+    if (!earth->tty_input_empty()) {
+        struct process* p = proc_lookup(GPID_SHELL);
+        if (p != NULL) {
+            /* Move the shell to the level 0 queue if it is queued. */
+            int queued = IS_READY(p->status);
+            if (queued) mlfq_dequeue(p);
+            mlfq_init(p);
+            if (queued) mlfq_enqueue(p);
+        }
+    }
+
+    /* Reset the level of all processes every MLFQ_RESET_PERIOD microseconds. */
+    if (current_time - MLFQ_last_reset_time >= MLFQ_RESET_PERIOD) { // More than RESET_PERIOD has passed
+        MLFQ_last_reset_time = current_time;
+
+        /* Splice every lower queue onto level 0 and bump the epoch, so the
+         * level of each process is reset when mlfq_level() next sees it. */
+        for (uint lvl = 1; lvl < MLFQ_NLEVELS; lvl++)
+            proc_queue_splice(&mlfq_ready[0], &mlfq_ready[lvl]);
+        if (mlfq_ready[0].head) mlfq_nonempty = 1;
+        mlfq_epoch++;
+        trace_record(EV_BOOST, NULL, 0);
+    }
+
+    /* Student's code ends here. */
+}
@@ -6,39 +6,179 @@
  */
 
 #include "process.h"
+#include <string.h>
 
-#define MLFQ_NLEVELS          5
-#define MLFQ_RESET_PERIOD     10000000         /* 10 seconds */
-#define MLFQ_LEVEL_RUNTIME(x) (x + 1) * 100000 /* e.g., 100ms for level 0 */
-extern struct process proc_set[MAX_NPROCESS + 1];
+extern struct process proc_set[PROC_SET_SIZE];
+struct sched_ops* sched = &mlfq_ops;
+
+void proc_queue_push(struct proc_queue* q, struct process* p) {
+    p->next = NULL;
+    p->prev = q->tail;
+    if (q->tail) q->tail->next = p;
+    else q->head = p;
+    q->tail = p;
+}
+
+void proc_queue_remove(struct proc_queue* q, struct process* p) {
+    if (p->prev) p->prev->next = p->next;
+    else q->head = p->next;
+    if (p->next) p->next->prev = p->prev;
+    else q->tail = p->prev;
+    p->prev = p->next = NULL;
+}
+
+/* The pid_map is an open-addressed hash table (with linear probing) from
+ * the pid of every allocated process to its slot in proc_set. */
+#define PID_MAP_SIZE (MAX_NPROCESS * 4)
+#define PID_HASH(x)  ((uint)(x) % PID_MAP_SIZE)
+static struct process* pid_map[PID_MAP_SIZE];
+
+struct process* proc_lookup(int pid) {
+    for (uint i = PID_HASH(pid); pid_map[i]; i = (i + 1) % PID_MAP_SIZE)
+        if (pid_map[i]->pid == pid) return pid_map[i];
+    return NULL;
+}
+
+static void pid_map_insert(struct process* p) {
+    uint i = PID_HASH(p->pid);
+    while (pid_map[i]) i = (i + 1) % PID_MAP_SIZE;
+    pid_map[i] = p;
+}
+
+static void pid_map_remove(int pid) {
+    uint i = PID_HASH(pid);
+    while (pid_map[i] && pid_map[i]->pid != pid) i = (i + 1) % PID_MAP_SIZE;
+    if (!pid_map[i]) return;
+
+    /* Shift later entries of the probe chain back into the hole, unless
+     * their home slot lies cyclically within (hole, entry]. */
+    for (uint j = (i + 1) % PID_MAP_SIZE; pid_map[j]; j = (j + 1) % PID_MAP_SIZE) {
+        uint h = PID_HASH(pid_map[j]->pid);
+        if (j > i ? (h <= i || h > j) : (h <= i && h > j)) {
+            pid_map[i] = pid_map[j];
+            i          = j;
+        }
+    }
+    pid_map[i] = NULL;
+}
+
+/* Sleeping processes are kept in a binary min-heap ordered by wake_time. */
+static struct process* sleep_heap[MAX_NPROCESS];
+static uint sleep_cnt;
+
+static void sleep_heap_set(uint i, struct process* p) {
+    sleep_heap[i] = p;
+    p->sleep_idx  = i;
+}
+
+static void sleep_heap_fix(uint i) {
+    struct process* p = sleep_heap[i];
+    /* Sift p up toward the root, and then down toward the leaves. */
+    for (uint parent; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (sleep_heap[parent]->wake_time <= p->wake_time) break;
+        sleep_heap_set(i, sleep_heap[parent]);
+    }
+    for (uint child; (child = 2 * i + 1) < sleep_cnt; i = child) {
+        if (child + 1 < sleep_cnt &&
+            sleep_heap[child + 1]->wake_time < sleep_heap[child]->wake_time)
+            child++;
+        if (p->wake_time <= sleep_heap[child]->wake_time) break;
+        sleep_heap_set(i, sleep_heap[child]);
+    }
+    sleep_heap_set(i, p);
+}
+
+static void sleep_heap_push(struct process* p) {
+    sleep_heap_set(sleep_cnt++, p);
+    sleep_heap_fix(sleep_cnt - 1);
+}
+
+static void sleep_heap_remove(struct process* p) {
+    uint i = p->sleep_idx;
+    if (i == --sleep_cnt) return;
+    sleep_heap_set(i, sleep_heap[sleep_cnt]);
+    sleep_heap_fix(i);
+}
+
+extern uint core_in_kernel;
+static void proc_wake_idle_core() {
+    /* Fire the timer of an idle core, if any, so that it picks the process
+     * which has just become ready; see the idle path of proc_yield. */
+    for (uint i = 0; i < NCORES; i++)
+        if (i != core_in_kernel && core_to_proc_idx[i] == IDLE_PROC_IDX(i)) {
+            earth->timer_reset(i, 0, 0);
+            return;
+        }
+}
 
 static void proc_set_status(int pid, enum proc_status status) {
-    for (uint i = 0; i < MAX_NPROCESS; i++)
-        if (proc_set[i].pid == pid) proc_set[i].status = status;
+    struct process* p = proc_lookup(pid);
+    if (p == NULL) return;
+
+    if (IS_READY(p->status) && !IS_READY(status)) sched->dequeue(p);
+    if (!IS_READY(p->status) && IS_READY(status)) {
+        sched->enqueue(p);
+        proc_wake_idle_core();
+    }
+    if (p->status == PROC_SLEEPING && status != PROC_SLEEPING)
+        sleep_heap_remove(p);
+    if (p->status != PROC_SLEEPING && status == PROC_SLEEPING)
+        sleep_heap_push(p);
+    p->status = status;
 }
 
 void proc_set_ready(int pid) { proc_set_status(pid, PROC_READY); }
 
 void proc_set_running(int pid) {
+    struct process* p = proc_lookup(pid);
+    if (p == NULL) return;
     proc_set_status(pid, PROC_RUNNING);
-    
-    for (uint i = 0; i < MAX_NPROCESS; i++) {
-        if (proc_set[i].pid == pid && proc_set[i].status != PROC_UNUSED) { // If this is the first time the process is running, then set t_started
-            if (!proc_set[i].has_started) {
-                proc_set[i].has_started = true;
-                proc_set[i].t_started = (uint) mtime_get();
-            }
-            proc_set[i].latest_running_start_time = mtime_get();
-            
-            break;
-        }
+
+    ulonglong now = mtime_get();
+    if (!p->has_started) { // If this is the first time the process is running, then set t_started
+        p->has_started = true;
+        p->t_started   = (uint) now;
     }
+    p->latest_running_start_time = now;
 }
 
 void proc_set_runnable(int pid) { proc_set_status(pid, PROC_RUNNABLE); }
 
 void proc_set_pending(int pid) { proc_set_status(pid, PROC_PENDING_SYSCALL); }
 
+void proc_ipc_fail(struct process* p) {
+    /* End the system call of p with FAILED, since its peer does not exist,
+     * and tell the user space of p as proc_copy_msg does in kernel.c. */
+    p->syscall.status    = FAILED;
+    p->syscall.len       = 0;
+    p->syscall.recv_page = 0;
+    if (p->syscall.type != SYS_FAULT && p->syscall.type != SYS_FAULT_WAIT) {
+        struct syscall* sc = (void*)earth->mmu_translate(p->pid, SYSCALL_ARG);
+        memcpy(sc, &p->syscall, SYSCALL_HDR_LEN);
+    }
+    proc_set_runnable(p->pid);
+}
+
+/* Unlink p from the senders queue it is blocked on, and fail the system
+ * calls of the processes sending to p or waiting to receive from p. */
+static void proc_ipc_detach(struct process* p) {
+    if (p->status == PROC_PENDING_SYSCALL && IS_SEND(p->syscall.type))
+        proc_queue_remove(&proc_lookup(p->syscall.receiver)->senders, p);
+
+    while (p->senders.head) {
+        struct process* sender = p->senders.head;
+        proc_queue_remove(&p->senders, sender);
+        proc_ipc_fail(sender);
+    }
+    for (uint i = 1; i <= MAX_NPROCESS; i++)
+        if (proc_set[i].status == PROC_PENDING_SYSCALL &&
+            IS_RECV(proc_set[i].syscall.type) &&
+            proc_set[i].syscall.status == PENDING &&
+            proc_set[i].syscall.sender == p->pid)
+            proc_ipc_fail(&proc_set[i]);
+}
+
 int proc_alloc() {
     static uint curr_pid = 0;
     for (uint i = 1; i <= MAX_NPROCESS; i++)
@@ -55,14 +195,34 @@ int proc_alloc() {
             proc_set[i].num_interrupts = 0;
             proc_set[i].has_started    = false;
 
-            proc_set[i].level = 0;
-            proc_set[i].t_remaining = MLFQ_LEVEL_RUNTIME(0);
-            
+            proc_set[i].tickets = STRIDE_DEFAULT_TICKETS;
+            proc_set[i].senders = (struct proc_queue){NULL, NULL};
+            proc_set[i].mailbox.count = proc_set[i].mailbox.used = 0;
+            sched->init(&proc_set[i]);
+            pid_map_insert(&proc_set[i]);
+
             /* Student's code ends here. */
             return curr_pid;
         }
 
     FATAL("proc_alloc: reach the limit of %d processes", MAX_NPROCESS);
+    return -1;
+}
+
+int proc_clone(int pid) {
+    /* Allocate a copy of process pid, which is blocked in a system call, and
+     * map its memory copy-on-write; the copy waits for the same reply. */
+    struct process* p = proc_lookup(pid);
+    if (p == NULL || p->status != PROC_PENDING_SYSCALL) return -1;
+
+    struct process* c = proc_lookup(proc_alloc());
+    c->syscall        = p->syscall;
+    c->mepc           = p->mepc;
+    c->tickets        = p->tickets;
+    memcpy(c->saved_registers, p->saved_registers, sizeof(c->saved_registers));
+    earth->mmu_clone(pid, c->pid);
+    proc_set_pending(c->pid);
+    return c->pid;
 }
 
 void proc_free(int pid) {
@@ -72,38 +232,38 @@ void proc_free(int pid) {
     ulonglong now = mtime_get();
 
     if (pid != GPID_ALL) {
-        // Iterating over the process set to find the process with the given pid
-        for (uint i = 0; i < MAX_NPROCESS; i++) {
-            if (proc_set[i].pid == pid && proc_set[i].status != PROC_UNUSED) {
-                proc_set[i].t_finished = (uint) now;
-                uint created   = proc_set[i].t_created;
-                uint started   = proc_set[i].t_started;
-                uint finished  = proc_set[i].t_finished;
-                uint turnaround = (finished - created);
-                uint response   = (started - created);
-                uint cpu        = proc_set[i].t_cpu;
-                uint interrupts       = proc_set[i].num_interrupts;
-
-                uint created_ms    = created   / 1000;
-                uint started_ms    = started   / 1000;
-                uint finished_ms   = finished  / 1000;
-                uint turnaround_ms = turnaround / 1000;
-                uint response_ms   = response   / 1000;
-                uint cpu_ms        = cpu        / 1000;
-
-                if (pid >= GPID_USER_START) {
-                    my_printf("[STATS] pid = %d | created = %d | started = %d | finished = %d\n", pid, created_ms, started_ms, finished_ms);
-                    my_printf("[STATS] pid = %d | turnaround = %d ms | response = %d ms | cpu time = %d ms | interrupts = %d\n", pid, turnaround_ms, response_ms, cpu_ms, interrupts);
-                }
-                break;
-            }
+        struct process* p = proc_lookup(pid);
+        if (p == NULL) return;
+
+        p->t_finished = (uint) now;
+        uint created    = p->t_created;
+        uint started    = p->t_started;
+        uint finished   = p->t_finished;
+        uint turnaround = (finished - created);
+        uint response   = (started - created);
+        uint cpu        = p->t_cpu;
+        uint interrupts = p->num_interrupts;
+
+        uint created_ms    = created   / 1000;
+        uint started_ms    = started   / 1000;
+        uint finished_ms   = finished  / 1000;
+        uint turnaround_ms = turnaround / 1000;
+        uint response_ms   = response   / 1000;
+        uint cpu_ms        = cpu        / 1000;
+
+        if (pid >= GPID_USER_START) {
+            my_printf("[STATS] pid = %d | created = %d | started = %d | finished = %d\n", pid, created_ms, started_ms, finished_ms);
+            my_printf("[STATS] pid = %d | turnaround = %d ms | response = %d ms | cpu time = %d ms | interrupts = %d\n", pid, turnaround_ms, response_ms, cpu_ms, interrupts);
         }
 
+        channel_close(pid);
         earth->mmu_free(pid);
+        proc_ipc_detach(p);
         proc_set_status(pid, PROC_UNUSED);
+        pid_map_remove(pid);
     } else {
         // Printing stats for all processes in the process set
-        for (uint i = 0; i < MAX_NPROCESS; i++) {
+        for (uint i = 1; i <= MAX_NPROCESS; i++) {
             if (proc_set[i].pid >= GPID_USER_START && proc_set[i].status != PROC_UNUSED) {
                 proc_set[i].t_finished = (uint) now;
                 uint p_id      = proc_set[i].pid;
@@ -130,101 +290,75 @@ void proc_free(int pid) {
         }
         
         /* Free all user processes. */
-        for (uint i = 0; i < MAX_NPROCESS; i++)
+        for (uint i = 1; i <= MAX_NPROCESS; i++)
             if (proc_set[i].pid >= GPID_USER_START &&
                 proc_set[i].status != PROC_UNUSED) {
+                channel_close(proc_set[i].pid);
                 earth->mmu_free(proc_set[i].pid);
-                proc_set[i].status = PROC_UNUSED;
+                proc_ipc_detach(&proc_set[i]);
+                proc_set_status(proc_set[i].pid, PROC_UNUSED);
+                pid_map_remove(proc_set[i].pid);
             }
     }
     /* Student's code ends here. */
 }
 
-void mlfq_update_level(struct process* p, ulonglong runtime) {
-    /* Student's code goes here (Preemptive Scheduler). */
 
-    /* Update the MLFQ-related fields in struct process* p after this
-     * process has run on the CPU for another runtime microseconds. */
+void proc_sleep(int pid, uint usec) {
+    /* Student's code goes here (System Call & Protection). */
 
-    if (p == NULL) return;
+    /* Refuse a process blocked on IPC, which waits for its peer instead. */
+    struct process* p = proc_lookup(pid);
+    if (p == NULL || (p->status == PROC_PENDING_SYSCALL &&
+                      p->syscall.type != SYS_SLEEP))
+        return;
 
-    if (p->pid >= GPID_USER_START) {
-        my_printf("[MLFQ] pid=%d runtime=%d before update: level=%d t_remaining=%d\n", (int)p->pid, (int)runtime, (int)p->level, (int)p->t_remaining);
-    }
-
-    if (runtime >= p->t_remaining) {
-        if (p->level < MLFQ_NLEVELS - 1) {
-            p->level++;
-        }
-        p->t_remaining = MLFQ_LEVEL_RUNTIME(p->level);
-    } else {
-        p->t_remaining -= runtime;
-    }
-
-    if (p->pid >= GPID_USER_START) {
-        my_printf("[MLFQ] pid=%d after update: level=%d t_remaining=%d\n", (int)p->pid, (int)p->level, (int)p->t_remaining);
-    }
+    p->wake_time = mtime_get() + usec;
+    if (p->status == PROC_SLEEPING) sleep_heap_fix(p->sleep_idx);
+    else proc_set_status(pid, PROC_SLEEPING);
 
     /* Student's code ends here. */
 }
 
-void mlfq_reset_level() {
-    /* Student's code goes here (Preemptive Scheduler). */
-    
-    static ulonglong MLFQ_last_reset_time = 0;
-    ulonglong current_time = mtime_get();
-    
-    /* Reset the level of GPID_SHELL if there is pending keyboard input. */
-    if (!earth->tty_input_empty()) {
-        for (uint i = 0; i < MAX_NPROCESS; i++) {
-            if (proc_set[i].pid == GPID_SHELL && proc_set[i].status != PROC_UNUSED) {
-                proc_set[i].level = 0;
-                proc_set[i].t_remaining = MLFQ_LEVEL_RUNTIME(0);
-                if (proc_set[i].pid >= GPID_USER_START) {
-                    my_printf("[MLFQ] Shell priority boosted due to keyboard input.\n");
-                }
-                break;
-            }
-        }
-    }
+void proc_wakeup() {
+    /* Make every process whose wake time has passed runnable. */
+    ulonglong now = mtime_get();
+    while (sleep_cnt && sleep_heap[0]->wake_time <= now)
+        proc_set_runnable(sleep_heap[0]->pid);
+}
 
-    /* Reset the level of all processes every MLFQ_RESET_PERIOD microseconds. */
-    if (current_time - MLFQ_last_reset_time >= MLFQ_RESET_PERIOD) { // More than RESET_PERIOD has passed
-        MLFQ_last_reset_time = current_time;
+ulonglong proc_next_wakeup() {
+    return sleep_cnt ? sleep_heap[0]->wake_time : (ulonglong)-1;
+}
 
-        for (uint i = 0; i < MAX_NPROCESS; i++) {
-            if (proc_set[i].status != PROC_UNUSED && proc_set[i].pid >= GPID_USER_START) {
-                proc_set[i].level = 0;
-                proc_set[i].t_remaining = MLFQ_LEVEL_RUNTIME(0);
-                my_printf("[MLFQ] Periodic reset: pid=%d moved to level 0\n", (int)proc_set[i].pid);
-            }
-        }
-    }
+struct process* proc_next() {
+    proc_wakeup(); // Waking up sleeping processes whose wake time has passed
 
-    /* Student's code ends here. */
+    return sched->pick_next();
 }
 
-void proc_sleep(int pid, uint usec) {
-    /* Student's code goes here (System Call & Protection). */
-    
-    for (uint i = 0; i < MAX_NPROCESS; i++) {
-        if (proc_set[i].pid == pid && proc_set[i].status != PROC_UNUSED) {
-            
-            ulonglong now = mtime_get();
-            proc_set[i].wake_time = now + usec;
-            proc_set[i].status = PROC_SLEEPING;
-
-            return;
-        }
-    }
-    
-    /* Student's code ends here. */
+void proc_set_tickets(int pid, uint tickets) {
+    /* Only user processes take tickets, at most STRIDE_BIG of them, so that
+     * the stride STRIDE_BIG / tickets is never 0. */
+    struct process* p = proc_lookup(pid);
+    if (p == NULL || pid < GPID_USER_START || tickets == 0) return;
+    if (tickets > STRIDE_BIG) tickets = STRIDE_BIG;
+
+    /* Requeue p, since its position may depend on its tickets. */
+    int queued = IS_READY(p->status);
+    if (queued) sched->dequeue(p);
+    p->tickets = tickets;
+    if (queued) sched->enqueue(p);
 }
 
 void proc_coresinfo() {
     /* Student's code goes here (Multicore & Locks). */
 
     /* Print out the pid of the process running on each CPU core. */
+    for (uint i = 0; i < NCORES; i++)
+        my_printf("[CORE] core #%d | pid = %d | idle = %d ms\n\r", i,
+                  proc_set[core_to_proc_idx[i]].pid,
+                  (int)(core_idle_time[i] / 1000));
 
     /* Student's code ends here. */
 }
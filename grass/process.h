@@ -15,11 +15,33 @@ enum proc_status {
     PROC_SLEEPING
 };
 
-#define MLFQ_NLEVELS          5
+#define MLFQ_NLEVELS           5
+#define STRIDE_DEFAULT_TICKETS 100
+#define STRIDE_BIG             (1 << 20) /* also the most tickets */
 #define MAX_NPROCESS        16
 #define SAVED_REGISTER_NUM  32
-#define SAVED_REGISTER_SIZE SAVED_REGISTER_NUM * 4
-#define SAVED_REGISTER_ADDR (void*)(EGOS_STACK_TOP - SAVED_REGISTER_SIZE)
+/* proc_set[1..MAX_NPROCESS] hold the processes, and the last NCORES slots
+ * hold the context of each idle core (see proc_yield in kernel.c). */
+#define PROC_SET_SIZE       (MAX_NPROCESS + 1 + NCORES)
+#define IDLE_PROC_IDX(core) (MAX_NPROCESS + 1 + (core))
+
+/* A bounded FIFO of the messages sent to a process while it was not
+ * receiving; order[] holds the used slots from the oldest to the newest. */
+#define MAILBOX_NSLOTS 4
+struct mailbox {
+    uint count, used; /* used is a bitmap of the used slots */
+    uchar order[MAILBOX_NSLOTS];
+    struct mailbox_msg {
+        int sender;
+        uint len;
+        char content[SYSCALL_MSG_LEN];
+    } slot[MAILBOX_NSLOTS];
+};
+
+/* An intrusive FIFO of processes linked through struct process. */
+struct proc_queue {
+    struct process *head, *tail;
+};
 
 struct process {
     int pid;
@@ -39,26 +61,73 @@ struct process {
     // MLFQ fields
     int level;
     uint t_remaining;
+    uint mlfq_epoch;             /* level is stale if != the boost epoch */
+    struct process *prev, *next; /* links in a ready or a senders queue  */
+
+    // Stride fields
+    uint tickets;
+    ulonglong pass;
+
+    // IPC fields
+    struct proc_queue senders; /* processes blocked sending to this one */
+    struct mailbox mailbox;    /* messages sent without blocking        */
 
     // Sleep and interrupt fields
     ulonglong latest_running_start_time;
     ulonglong wake_time;
+    uint sleep_idx; /* position in the sleep heap while PROC_SLEEPING */
 
     /* Student's code ends here. */
 };
 
 ulonglong mtime_get();
 
+/* A scheduling policy, chosen at boot; see grass/mlfq.c and grass/stride.c.
+ * A process is on the ready queue of the policy iff IS_READY(p->status). */
+struct sched_ops {
+    char* name;
+    void (*init)(struct process* p);    /* p has just been allocated     */
+    void (*enqueue)(struct process* p); /* p becomes ready or runnable   */
+    void (*dequeue)(struct process* p); /* p stops being ready/runnable  */
+    struct process* (*pick_next)();     /* head of the ready queue       */
+    void (*on_tick)(struct process* p, ulonglong runtime);  /* timer intr */
+    void (*on_block)(struct process* p, ulonglong runtime); /* ecall      */
+    uint (*slice)(struct process* p);   /* timer quanta for the next run */
+};
+extern struct sched_ops *sched, mlfq_ops, stride_ops;
+#define IS_READY(x) ((x) == PROC_READY || (x) == PROC_RUNNABLE)
+
 int proc_alloc();
+int proc_clone(int);
 void proc_free(int);
+struct process* proc_lookup(int pid);
 void proc_set_ready(int);
 void proc_set_running(int);
 void proc_set_runnable(int);
 void proc_set_pending(int);
+void proc_ipc_fail(struct process* p);
+void proc_set_tickets(int pid, uint tickets);
 
 void mlfq_reset_level();
 void mlfq_update_level(struct process* p, ulonglong runtime);
+void proc_queue_push(struct proc_queue* q, struct process* p);
+void proc_queue_remove(struct proc_queue* q, struct process* p);
 void proc_sleep(int pid, uint usec);
+void proc_wakeup();
+ulonglong proc_next_wakeup();
+struct process* proc_next();
 void proc_coresinfo();
 
+void trace_record(uint type, struct process* p, uint runtime);
+uint trace_drain(struct sched_event* buf, uint max);
+
+int channel_open(int pid, int peer);
+int channel_lookup(int pid, int peer);
+void channel_close(int pid);
+int channel_peer(uint chan, int pid);
+void channel_ring(uint chan, int pid);
+int channel_take_bell(int pid, int from);
+int channel_take_bell_of(uint chan, int pid);
+
 extern uint core_to_proc_idx[NCORES];
+extern ulonglong core_idle_time[NCORES];
@@ -0,0 +1,63 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: the stride (proportional-share) scheduling policy
+ * Every process holds some tickets and its stride is inversely proportional
+ * to them. The scheduler runs the process with the smallest pass, and the
+ * pass advances by the stride for every STRIDE_UNIT of CPU time consumed,
+ * so each process gets a CPU share proportional to its tickets.
+ */
+
+#include "process.h"
+
+#define STRIDE_UNIT 100000 /* the CPU time charged one full stride */
+
+/* Runnable processes sorted by pass, with ties in FIFO order. */
+static struct proc_queue stride_ready;
+static ulonglong stride_global_pass; /* the pass of the last pick */
+
+static void stride_init(struct process* p) { p->pass = 0; }
+
+static void stride_enqueue(struct process* p) {
+    /* A process returning from sleep or I/O cannot spend saved-up CPU. */
+    if (p->pass < stride_global_pass) p->pass = stride_global_pass;
+
+    struct process* pos = stride_ready.head;
+    while (pos && pos->pass <= p->pass) pos = pos->next;
+    if (pos == NULL) {
+        proc_queue_push(&stride_ready, p);
+        return;
+    }
+
+    /* Insert p right before pos. */
+    p->next = pos;
+    p->prev = pos->prev;
+    if (pos->prev) pos->prev->next = p;
+    else stride_ready.head = p;
+    pos->prev = p;
+}
+
+static void stride_dequeue(struct process* p) {
+    proc_queue_remove(&stride_ready, p);
+}
+
+static struct process* stride_pick() {
+    if (stride_ready.head) stride_global_pass = stride_ready.head->pass;
+    return stride_ready.head;
+}
+
+static void stride_charge(struct process* p, ulonglong runtime) {
+    p->pass += (ulonglong)(STRIDE_BIG / p->tickets) * runtime / STRIDE_UNIT;
+}
+
+static uint stride_slice(struct process* p) { return 1; }
+
+struct sched_ops stride_ops = {.name      = "stride",
+                               .init      = stride_init,
+                               .enqueue   = stride_enqueue,
+                               .dequeue   = stride_dequeue,
+                               .pick_next = stride_pick,
+                               .on_tick   = stride_charge,
+                               .on_block  = stride_charge,
+                               .slice     = stride_slice};
@@ -0,0 +1,50 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: scheduler event tracing
+ * The kernel records timer interrupts, context switches and MLFQ level
+ * changes into a fixed-size ring with a few stores per event; the shell
+ * drains the ring in bulk with the trace command.
+ */
+
+#include "process.h"
+
+#define TRACE_NEVENTS SCHED_TRACE_NEVENTS
+static struct sched_event trace_ring[TRACE_NEVENTS];
+static uint trace_head, trace_tail; /* free-running event counters */
+static uint trace_done;             /* trace_head after the last event */
+extern uint core_in_kernel;
+
+void trace_record(uint type, struct process* p, uint runtime) {
+    /* Take the slot before writing it, so that trace_drain can tell that
+     * an event has been overwritten while it was copying the event. */
+    struct sched_event* e = &trace_ring[trace_head++ % TRACE_NEVENTS];
+    __sync_synchronize();
+    e->time    = mtime_get();
+    e->core    = core_in_kernel;
+    e->type    = type;
+    e->level   = p ? p->level : 0;
+    e->pid     = p ? p->pid : GPID_ALL;
+    e->runtime = runtime;
+    __sync_synchronize();
+    trace_done = trace_head;
+}
+
+uint trace_drain(struct sched_event* buf, uint max) {
+    /* Drain the events recorded before the call, so that the events which
+     * the caller causes by printing them are left for the next drain. The
+     * caller runs with interrupts on, so trace_record may reuse a slot in
+     * the middle of the copy; such events are dropped as torn. */
+    uint end = trace_done;
+    __sync_synchronize();
+    if (end - trace_tail > TRACE_NEVENTS) trace_tail = end - TRACE_NEVENTS;
+
+    uint n = 0;
+    for (; trace_tail != end && n < max; trace_tail++) {
+        buf[n] = trace_ring[trace_tail % TRACE_NEVENTS];
+        __sync_synchronize();
+        if (trace_head - trace_tail <= TRACE_NEVENTS) n++;
+    }
+    return n;
+}
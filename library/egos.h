@@ -9,11 +9,18 @@ struct earth {
     uint (*mmu_alloc)();
     void (*mmu_free)(int pid);
     void (*mmu_flush_cache)();
-    void (*timer_reset)(uint core_id);
+    void (*timer_reset)(uint core_id, uint nquantum, ulonglong wakeup);
 
     void (*mmu_map)(int pid, uint vpage_no, uint ppage_id);
+    void (*mmu_share)(int pid, uint ppage_id);
+    void (*mmu_unmap)(int pid, uint ppage_id);
+    int (*mmu_exchange)(int pid, uint vpage_no, int peer, uint peer_vpage_no);
     uint (*mmu_translate)(int pid, uint vaddr);
     void (*mmu_switch)(int pid);
+    int (*mmu_fault)(int pid, uint vaddr);
+    void (*mmu_map_file)(int pid, uint vpage_no);
+    void (*mmu_map_shared)(int pid, uint vpage_no, uint ppage_id);
+    int (*mmu_clone)(int pid, int child);
 
     void (*tty_read)(char* c);
     void (*tty_write)(char c);
@@ -25,16 +32,37 @@ struct earth {
     enum { PAGE_TABLE, SOFT_TLB } translation;
 };
 
+struct sched_event {
+    ulonglong time; /* mtime when the event is recorded */
+    uchar core, type, level;
+    int pid;
+    uint runtime;
+};
+enum sched_event_type { EV_INTR, EV_SCHED, EV_MLFQ, EV_BOOST };
+#define SCHED_TRACE_NEVENTS 256 /* the events kept by the kernel */
+
 struct grass {
     int (*proc_alloc)();
     void (*proc_free)(int pid);
     void (*proc_set_ready)(int pid);
+    int (*proc_clone)(int pid);
 
-    void (*sys_send)(int receiver, char* msg, uint size);
-    void (*sys_recv)(int from, int* sender, char* buf, uint size);
+    int (*sys_send)(int receiver, char* msg, uint size);
+    int (*sys_send_page)(int receiver, char* msg, uint size, char* page);
+    uint (*sys_recv)(int from, int* sender, char* buf, uint size);
+    uint (*sys_call)(int receiver, char* msg, uint size, char* buf, uint len);
+    uint (*sys_reply_recv)(int client, char* msg, uint size, int from,
+                           int* sender, char* buf, uint len);
+    uint (*sys_reply_recv_page)(int client, char* msg, uint size, char* page,
+                                int from, int* sender, char* buf, uint len);
     /* Student's code goes here (System Call | Multicore & Locks). */
 
     /* Add interface functions for process sleep and multicore information. */
+    void (*proc_set_tickets)(int pid, uint tickets);
+    void (*proc_coresinfo)();
+    uint (*sched_trace)(struct sched_event* buf, uint max);
+    int (*channel_open)(int pid, int peer);
+    int (*channel_lookup)(int pid, int peer);
 
     /* Student's code ends here. */
 };
@@ -46,6 +74,8 @@ extern struct grass* grass;
 #define RAM_END           0x80600000 /* 6MB memory [0x80000000,0x80600000)  */
 #define APPS_PAGES_BASE   0x80400000 /* 2MB free for mmu_alloc              */
 #define APPS_STACK_TOP    0x80400000 /* 1MB app stack (growing down)        */
+#define APPS_STACK_END    0x80310000 /* the app stack grows down to here    */
+#define CHANNEL_BASE      0x80303000 /* shared-memory ring channels         */
 #define SHELL_WORK_DIR    0x80302000 /* current work directory for shell    */
 #define SYSCALL_ARG       0x80301000 /* struct syscall                      */
 #define APPS_ARG          0x80300000 /* main() arguments (argc and argv)    */
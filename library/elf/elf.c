@@ -14,28 +14,85 @@
 #define PAGE_SIZE          4096
 #define PAGE_ID_TO_ADDR(x) ((char*)APPS_PAGES_BASE + x * PAGE_SIZE)
 
-void elf_load(int pid, elf_reader reader, int argc, void** argv) {
-    /* Load the ELF header. */
-    char hbuf[BLOCK_SIZE], buf[BLOCK_SIZE];
-    reader(0, hbuf);
+void elf_parse(char* hbuf, struct elf_phdrs* phdrs) {
+    /* Keep the program headers of the segments loaded into memory. */
     struct elf32_header* header          = (void*)hbuf;
     struct elf32_program_header* pheader = (void*)(hbuf + header->e_phoff);
 
-    /* Load the code and data memory regions. */
+    phdrs->phnum = 0;
     for (uint i = 0; i < header->e_phnum; i++) {
-        uint addr = pheader[i].p_vaddr;
-        if (addr < RAM_START) continue;
+        if (pheader[i].p_vaddr < RAM_START) continue;
+        if (phdrs->phnum == ELF_NPHDRS)
+            FATAL("elf_parse: more than %d loadable segments", ELF_NPHDRS);
+        phdrs->ph[phdrs->phnum++] = pheader[i];
+    }
+}
+
+void elf_load(int pid, elf_reader reader, struct elf_phdrs* phdrs, int argc,
+              void** argv, struct elf_image* image) {
+    /* Load the ELF header, unless the caller has parsed it already. */
+    char buf[BLOCK_SIZE];
+    struct elf_phdrs parsed;
+    if (!phdrs) {
+        reader(0, buf);
+        elf_parse(buf, &parsed);
+        phdrs = &parsed;
+    }
+    struct elf32_program_header* pheader = phdrs->ph;
 
+    /* With page tables and an image, the pages holding file data are loaded
+     * by elf_fault on their first access instead. */
+    int lazy = image && earth->translation == PAGE_TABLE;
+    if (image) image->nsegs = 0;
+
+    /* The read-only segment of an image is mapped from image->text if the
+     * caller has set image->ntext (e.g., from another instance of the same
+     * executable), or is loaded into pages recorded in image->text, where
+     * the pages left to elf_fault are ELF_NO_PAGE. */
+    uint ntext = image ? image->ntext : 0;
+    if (image) image->ntext = 0;
+
+    /* Load the code and data memory regions. */
+    for (uint i = 0; i < phdrs->phnum; i++) {
+        uint addr         = pheader[i].p_vaddr;
         uint memsz        = pheader[i].p_memsz;
         uint filesz       = pheader[i].p_filesz;
         uint curr_pageno  = addr / PAGE_SIZE;
         uint end_pageno   = (addr + memsz) / PAGE_SIZE;
         uint curr_blockno = pheader[i].p_offset / BLOCK_SIZE;
+        int text = image && !(pheader[i].p_flags & PF_W) && memsz == filesz &&
+                   addr == APPS_ENTRY && memsz <= ELF_NTEXT * PAGE_SIZE;
+        int seg = lazy && image->nsegs < ELF_NSEGS;
+        if (seg)
+            image->seg[image->nsegs++] =
+                (struct elf_segment){addr, filesz, pheader[i].p_offset};
+        if (text && (ntext || seg)) {
+            image->ntext = (filesz + PAGE_SIZE - 1) / PAGE_SIZE;
+            for (uint k = 0; k < image->ntext; k++, curr_pageno++) {
+                if (!ntext) image->text[k] = ELF_NO_PAGE;
+                if (image->text[k] == ELF_NO_PAGE)
+                    earth->mmu_map_file(pid, curr_pageno);
+                else
+                    earth->mmu_map_shared(pid, curr_pageno, image->text[k]);
+            }
+            continue;
+        }
+        if (seg) {
+            for (; curr_pageno * PAGE_SIZE < addr + filesz; curr_pageno++)
+                earth->mmu_map_file(pid, curr_pageno);
+            continue;
+        }
+
         for (uint ppage_id, off = 0; off < filesz; off += BLOCK_SIZE) {
             /* Allocate one page (4KB) for every 8 blocks (512 bytes). */
             if (off % PAGE_SIZE == 0) {
                 ppage_id = earth->mmu_alloc();
-                earth->mmu_map(pid, curr_pageno++, ppage_id);
+                if (text) {
+                    image->text[image->ntext++] = ppage_id;
+                    earth->mmu_map_shared(pid, curr_pageno++, ppage_id);
+                } else {
+                    earth->mmu_map(pid, curr_pageno++, ppage_id);
+                }
                 memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
             }
             uint size =
@@ -44,7 +101,9 @@ void elf_load(int pid, elf_reader reader, int argc, void** argv) {
             memcpy(PAGE_ID_TO_ADDR(ppage_id) + (off % PAGE_SIZE), buf, size);
         }
 
-        while (curr_pageno < end_pageno) {
+        /* With page tables, the zero pages are mapped on the first page
+         * fault instead; see mmu_fault. */
+        while (curr_pageno < end_pageno && earth->translation == SOFT_TLB) {
             uint ppage_id = earth->mmu_alloc();
             earth->mmu_map(pid, curr_pageno++, ppage_id);
             memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
@@ -73,9 +132,44 @@ void elf_load(int pid, elf_reader reader, int argc, void** argv) {
     ppage_id = earth->mmu_alloc();
     earth->mmu_map(pid, SYSCALL_ARG / PAGE_SIZE, ppage_id);
 
-    /* Setup 2 pages for user stack (enough for teaching purpose). */
-    for (uint i = 1; i <= 2; i++) {
+    /* Setup 2 pages for user stack (enough for teaching purpose); with page
+     * tables, the stack grows on page faults down to APPS_STACK_END. */
+    for (uint i = 1; i <= 2 && earth->translation == SOFT_TLB; i++) {
         ppage_id = earth->mmu_alloc();
         earth->mmu_map(pid, APPS_STACK_TOP / PAGE_SIZE - i, ppage_id);
     }
 }
+
+int elf_fault(int pid, elf_reader reader, struct elf_image* image,
+              uint vaddr) {
+    /* Map a zeroed page at vaddr, and read the blocks of the segment which
+     * fall into the page; segments start at page boundaries as in elf_load.
+     * A page of the read-only segment is recorded in image->text and mapped
+     * shared, so that the caller can map it to the other instances. */
+    char buf[BLOCK_SIZE];
+    uint page = vaddr / PAGE_SIZE * PAGE_SIZE;
+    for (uint i = 0; i < image->nsegs; i++) {
+        struct elf_segment* seg = &image->seg[i];
+        if (page < seg->vaddr || page >= seg->vaddr + seg->filesz) continue;
+
+        uint ppage_id = earth->mmu_alloc();
+        memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
+        for (uint off = page - seg->vaddr;
+             off < seg->filesz && off < page - seg->vaddr + PAGE_SIZE;
+             off += BLOCK_SIZE) {
+            uint left = seg->filesz - off;
+            uint size = (left < BLOCK_SIZE) ? left : BLOCK_SIZE;
+            reader((seg->offset + off) / BLOCK_SIZE, buf);
+            memcpy(PAGE_ID_TO_ADDR(ppage_id) + (off % PAGE_SIZE), buf, size);
+        }
+        uint k = (page - APPS_ENTRY) / PAGE_SIZE;
+        if (seg->vaddr == APPS_ENTRY && k < image->ntext) {
+            image->text[k] = ppage_id;
+            earth->mmu_map_shared(pid, page / PAGE_SIZE, ppage_id);
+        } else {
+            earth->mmu_map(pid, page / PAGE_SIZE, ppage_id);
+        }
+        return 0;
+    }
+    return -1;
+}
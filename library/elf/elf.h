@@ -28,5 +28,35 @@ struct elf32_program_header {
     uint p_align;
 };
 
+#define PF_W 0x2 /* p_flags of a writable segment */
+
+/* The loadable segments of an executable, which elf_load records for
+ * elf_fault instead of loading them when page tables are used, and the
+ * pages of its read-only segment, which the instances of the executable
+ * share; a page not loaded yet is ELF_NO_PAGE. See elf_load. */
+#define ELF_NSEGS   4
+#define ELF_NTEXT   8
+#define ELF_NO_PAGE ((uint)-1)
+struct elf_image {
+    uint nsegs;
+    struct elf_segment {
+        uint vaddr, filesz, offset;
+    } seg[ELF_NSEGS];
+    uint ntext;
+    uint text[ELF_NTEXT];
+};
+
+/* The program headers of the loadable segments of an executable, which
+ * elf_parse takes from its first block; a caller spawning an executable
+ * again can keep them for elf_load instead of the first block. */
+#define ELF_NPHDRS 8
+struct elf_phdrs {
+    uint phnum;
+    struct elf32_program_header ph[ELF_NPHDRS];
+};
+
 typedef void (*elf_reader)(uint block_no, char* dst);
-void elf_load(int pid, elf_reader reader, int argc, void** argv);
+void elf_parse(char* hbuf, struct elf_phdrs* phdrs);
+void elf_load(int pid, elf_reader reader, struct elf_phdrs* phdrs, int argc,
+              void** argv, struct elf_image* image);
+int elf_fault(int pid, elf_reader reader, struct elf_image* image, uint vaddr);
@@ -0,0 +1,74 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: shared-memory ring channels
+ * chan_open() asks GPID_PROCESS to map a page shared with a server; both
+ * sides then copy bytes in and out of the ring with chan_write() and
+ * chan_read(), and only trap into the kernel to ring a doorbell when the
+ * ring was empty, or when the producer waits for room in a full ring.
+ */
+
+#include "egos.h"
+#include "syscall.h"
+#include <string.h>
+
+int chan_open(int server) {
+    struct proc_request req;
+    struct proc_reply reply;
+    req.type = PROC_CHANNEL;
+    req.pid  = server;
+    sys_call(GPID_PROCESS, (void*)&req, offsetof(struct proc_request, argv),
+             (void*)&reply, sizeof(reply));
+    return reply.type == CMD_OK ? reply.chan : -1;
+}
+
+uint chan_write(int chan, char* buf, uint len) {
+    struct chan_ring* ring = (void*)CHANNEL_ADDR(chan);
+    for (uint n, left = len; left; buf += n, left -= n) {
+        uint head = ring->head, tail = ring->tail;
+        uint space = (head + CHAN_RING_SIZE - tail - 1) % CHAN_RING_SIZE;
+        if ((n = left < space ? left : space) == 0) {
+            /* Ask the consumer for a doorbell and wait for it, unless the
+             * consumer has made room meanwhile. Whoever clears ring->wait
+             * first decides if the doorbell rings, so that it never rings
+             * when nobody waits for it. */
+            ring->wait = 1;
+            __sync_synchronize();
+            if (ring->head == head || !__sync_fetch_and_and(&ring->wait, 0))
+                sys_bell_wait(chan);
+            continue;
+        }
+
+        /* Copy in two pieces if the ring wraps around. */
+        uint first = CHAN_RING_SIZE - tail < n ? CHAN_RING_SIZE - tail : n;
+        memcpy(ring->data + tail, buf, first);
+        memcpy(ring->data, buf + first, n - first);
+        __sync_synchronize();
+        ring->tail = (tail + n) % CHAN_RING_SIZE;
+        __sync_synchronize();
+
+        /* The consumer may have found the ring empty and wait for it. */
+        if (ring->head == tail) sys_doorbell(chan);
+    }
+    return len;
+}
+
+uint chan_read(int chan, char* buf, uint len) {
+    struct chan_ring* ring = (void*)CHANNEL_ADDR(chan);
+    uint head = ring->head, tail = ring->tail;
+    uint avail = (tail + CHAN_RING_SIZE - head) % CHAN_RING_SIZE;
+    uint n     = len < avail ? len : avail;
+    if (n == 0) return 0;
+
+    uint first = CHAN_RING_SIZE - head < n ? CHAN_RING_SIZE - head : n;
+    memcpy(buf, ring->data + head, first);
+    memcpy(buf + first, ring->data, n - first);
+    __sync_synchronize();
+    ring->head = (head + n) % CHAN_RING_SIZE;
+    __sync_synchronize();
+
+    /* Ring the producer only if it waits for room; see chan_write(). */
+    if (__sync_fetch_and_and(&ring->wait, 0)) sys_doorbell(chan);
+    return n;
+}
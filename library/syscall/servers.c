@@ -10,22 +10,24 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int sender;
 static char buf[SYSCALL_MSG_LEN];
+static void term_flush();
 
 void exit(int status) {
+    term_flush();
     struct proc_request req;
     req.type = PROC_EXIT;
-    sys_send(GPID_PROCESS, (void*)&req, sizeof(req));
+    sys_send(GPID_PROCESS, (void*)&req, offsetof(struct proc_request, argv));
     while (1);
 }
 
 void sleep(uint usec) {
     /* Student's code goes here (System Call & Protection). */
 
-    /* Send a message to GPID_PROCESS for process sleep. For simplicity,
-     * you can assume that GPID_PROCESS will be scheduled and handle the
-     * message before the kernel re-schedules the current process. */
+    /* Sleep in the kernel rather than asking GPID_PROCESS, which could only
+     * put the caller to sleep after replying to it, and thus maybe after the
+     * caller has run again on another core. */
+    sys_sleep(usec);
 
     /* Student's code ends here. */
 }
@@ -49,8 +51,7 @@ int file_read(int file_ino, uint offset, char* block) {
     req.ino    = file_ino;
     req.offset = offset;
 
-    sys_send(GPID_FILE, (void*)&req, sizeof(req));
-    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+    sys_call(GPID_FILE, (void*)&req, sizeof(req), buf, SYSCALL_MSG_LEN);
 
     struct file_reply* reply = (void*)buf;
     memcpy(block, reply->block.bytes, BLOCK_SIZE);
@@ -58,6 +59,33 @@ int file_read(int file_ino, uint offset, char* block) {
     return reply->status == FILE_OK ? 0 : -1;
 }
 
+int file_read_page(int file_ino, uint offset, char* page) {
+    /* Read FILE_PAGE_NBLOCKS blocks from offset into the page-aligned page,
+     * which GPID_FILE remaps from its address space instead of copying. */
+    struct file_request req;
+    struct file_reply reply;
+    req.type   = FILE_READ_PAGE;
+    req.ino    = file_ino;
+    req.offset = offset;
+
+    /* Touch the page first: with page tables, it may not be mapped yet. */
+    *(volatile char*)page = 0;
+    if (sys_call_page(GPID_FILE, (void*)&req, sizeof(req), (void*)&reply,
+                      offsetof(struct file_reply, block), page))
+        return reply.status == FILE_OK ? 0 : -1;
+
+    /* Fall back to reading the blocks one by one. */
+    for (uint i = 0; i < FILE_PAGE_NBLOCKS; i++)
+        if (file_read(file_ino, offset + i, page + i * BLOCK_SIZE) < 0) {
+            /* Blocks past the end of the file read as zeros. */
+            if (i == 0) return -1;
+            memset(page + i * BLOCK_SIZE, 0,
+                   (FILE_PAGE_NBLOCKS - i) * BLOCK_SIZE);
+            break;
+        }
+    return 0;
+}
+
 #ifndef KERNEL
 
 /* Terminal read/write for user applications send messages to GPID_TERMINAL. */
@@ -66,18 +94,62 @@ int term_read(char* buf, uint len) {
     struct term_reply reply;
     req.type = TERM_INPUT;
     req.len  = len;
-    sys_send(GPID_TERMINAL, (void*)&req, sizeof(req));
-    sys_recv(GPID_TERMINAL, NULL, (void*)&reply, sizeof(reply));
+    sys_call(GPID_TERMINAL, (void*)&req, offsetof(struct term_request, buf),
+             (void*)&reply, sizeof(reply));
     memcpy(buf, reply.buf, reply.len);
     return reply.len;
 }
 
+/* Terminal output goes through a channel to GPID_TERMINAL, opened by the
+ * first term_write, or through messages if no channel is available. */
+static int term_chan = -1, term_chan_tried;
+
 void term_write(char* str, uint len) {
+    if (!term_chan_tried) {
+        term_chan_tried = 1;
+        term_chan       = chan_open(GPID_TERMINAL);
+    }
+    if (term_chan >= 0) {
+        chan_write(term_chan, str, len);
+        return;
+    }
+
     struct term_request req;
     req.type = TERM_OUTPUT;
     req.len  = len;
-    memcpy(req.buf, str, len);
-    sys_send(GPID_TERMINAL, (void*)&req, sizeof(req));
+    /* Send the header and str without copying str into req.buf. */
+    sys_sendv(GPID_TERMINAL, (void*)&req, offsetof(struct term_request, buf),
+              str, len);
+}
+
+static void term_flush() {
+    /* Wait until GPID_TERMINAL has printed everything in the channel. */
+    if (term_chan < 0) return;
+    struct term_request req;
+    struct term_reply reply;
+    req.type = TERM_FLUSH;
+    req.len  = 0;
+    sys_call(GPID_TERMINAL, (void*)&req, offsetof(struct term_request, buf),
+             (void*)&reply, sizeof(reply));
+}
+
+int fork() {
+    /* Clone the calling process, whose memory the clone shares copy-on-write;
+     * return the pid of the clone, 0 in the clone, or -1 on failure. */
+    term_flush();
+    struct proc_request req;
+    struct proc_reply reply;
+    req.type = PROC_CLONE;
+    sys_call(GPID_PROCESS, (void*)&req, offsetof(struct proc_request, argv),
+             (void*)&reply, sizeof(reply));
+    if (reply.type != CMD_OK) return -1;
+
+    /* The channels of the caller are not cloned; see mmu_clone. */
+    if (reply.pid == 0) {
+        term_chan       = -1;
+        term_chan_tried = 0;
+    }
+    return reply.pid;
 }
 
 #else
@@ -110,4 +182,6 @@ void term_write(char* str, uint len) {
     for (uint i = 0; i < len; i++) earth->tty_write(str[i]);
 }
 
+static void term_flush() {}
+
 #endif
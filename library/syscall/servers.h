@@ -2,10 +2,12 @@
 
 void exit(int status);
 void sleep(uint usec);
+int fork();
 int term_read(char* buf, uint len);
 void term_write(char* str, uint len);
 int dir_lookup(int dir_ino, char* name);
 int file_read(int file_ino, uint offset, char* block);
+int file_read_page(int file_ino, uint offset, char* page);
 
 enum grass_servers {
     GPID_ALL = -1,
@@ -25,7 +27,17 @@ struct proc_request {
     /* Student's code goes here (System Call & Protection). */
 
     /* Update struct proc_request to support process sleep. */
-    enum { PROC_SPAWN, PROC_EXIT, PROC_KILLALL } type;
+    enum {
+        PROC_SPAWN,
+        PROC_EXIT,
+        PROC_KILLALL,
+        PROC_TICKETS,
+        PROC_CHANNEL,
+        PROC_CLONE,
+        PROC_FAULT /* sent by the kernel on a page fault, see elf_fault */
+    } type;
+    uint vaddr;       /* PROC_FAULT                     */
+    int pid, tickets; /* PROC_TICKETS; pid: PROC_CHANNEL */
     int argc;
     char argv[CMD_NARGS][CMD_ARG_LEN];
     /* Student's code ends here. */
@@ -33,12 +45,14 @@ struct proc_request {
 
 struct proc_reply {
     enum { CMD_OK, CMD_ERROR } type;
+    int chan; /* PROC_CHANNEL */
+    int pid;  /* PROC_CLONE: the clone, or 0 in the clone */
 };
 
 /* GPID_TERMINAL */
 #define TERM_BUF_SIZE 512
 struct term_request {
-    enum { TERM_INPUT, TERM_OUTPUT } type;
+    enum { TERM_INPUT, TERM_OUTPUT, TERM_FLUSH } type;
     uint len;
     char buf[TERM_BUF_SIZE];
 };
@@ -55,12 +69,15 @@ struct file_request {
         FILE_UNUSED,
         FILE_READ,
         FILE_WRITE,
+        FILE_READ_PAGE, /* FILE_PAGE_NBLOCKS blocks sent as a page */
     } type;
     uint ino;
     uint offset;
     block_t block;
 };
 
+#define FILE_PAGE_NBLOCKS 8 /* PAGE_SIZE / BLOCK_SIZE */
+
 struct file_reply {
     enum file_status { FILE_OK, FILE_ERROR } status;
     block_t block;
@@ -11,17 +11,119 @@
 
 static struct syscall* sc = (struct syscall*)SYSCALL_ARG;
 
-void sys_send(int receiver, char* msg, uint size) {
-    sc->type     = SYS_SEND;
-    sc->receiver = receiver;
-    memcpy(sc->content, msg, size);
+static int sys_sendv_page(int receiver, char* hdr, uint hdr_len, char* body,
+                          uint body_len, char* page) {
+    if (hdr_len + body_len > SYSCALL_MSG_LEN)
+        FATAL("sys_send: message of %d bytes > SYSCALL_MSG_LEN",
+              hdr_len + body_len);
+
+    sc->type      = SYS_SEND;
+    sc->receiver  = receiver;
+    sc->len       = hdr_len + body_len;
+    sc->send_page = (uint)page;
+    sc->status    = PENDING;
+    memcpy(sc->content, hdr, hdr_len);
+    memcpy(sc->content + hdr_len, body, body_len);
+    asm("ecall");
+    return sc->status == FAILED ? -1 : 0;
+}
+
+int sys_sendv(int receiver, char* hdr, uint hdr_len, char* body,
+              uint body_len) {
+    return sys_sendv_page(receiver, hdr, hdr_len, body, body_len, NULL);
+}
+
+int sys_send_page(int receiver, char* msg, uint size, char* page) {
+    return sys_sendv_page(receiver, msg, size, NULL, 0, page);
+}
+
+uint sys_recvv(int from, int* sender, char* hdr, uint hdr_len, char* body,
+               uint body_len) {
+    sc->type      = SYS_RECV;
+    sc->sender    = from;
+    sc->recv_page = 0;
+    sc->status    = PENDING;
     asm("ecall");
+    if (sc->status == FAILED) return SYS_FAILED;
+
+    /* Only the first sc->len bytes of sc->content hold the message. */
+    uint len = sc->len;
+    memcpy(hdr, sc->content, len < hdr_len ? len : hdr_len);
+    if (len > hdr_len)
+        memcpy(body, sc->content + hdr_len,
+               len - hdr_len < body_len ? len - hdr_len : body_len);
+    if (sender) *sender = sc->sender;
+    return len;
 }
 
-void sys_recv(int from, int* sender, char* buf, uint size) {
-    sc->type   = SYS_RECV;
-    sc->sender = from;
+static uint sys_sendrecv(enum syscall_type type, int receiver, char* msg,
+                         uint size, int from, int* sender, char* buf,
+                         uint len, char* send_page, char* recv_page) {
+    if (size > SYSCALL_MSG_LEN)
+        FATAL("sys_send: message of %d bytes > SYSCALL_MSG_LEN", size);
+
+    sc->type      = type;
+    sc->receiver  = receiver;
+    sc->sender    = from;
+    sc->len       = size;
+    sc->send_page = (uint)send_page;
+    sc->recv_page = (uint)recv_page;
+    sc->status    = PENDING;
+    memcpy(sc->content, msg, size);
     asm("ecall");
-    memcpy(buf, sc->content, size);
+    if (sc->status == FAILED) return SYS_FAILED;
+
+    memcpy(buf, sc->content, sc->len < len ? sc->len : len);
     if (sender) *sender = sc->sender;
+    return sc->len;
+}
+
+uint sys_call(int receiver, char* msg, uint size, char* buf, uint len) {
+    return sys_sendrecv(SYS_CALL, receiver, msg, size, receiver, NULL, buf,
+                        len, NULL, NULL);
+}
+
+uint sys_call_page(int receiver, char* msg, uint size, char* buf, uint len,
+                   char* page) {
+    sys_sendrecv(SYS_CALL, receiver, msg, size, receiver, NULL, buf, len, NULL,
+                 page);
+    return sc->recv_page != 0;
+}
+
+uint sys_reply_recv(int client, char* msg, uint size, int from, int* sender,
+                    char* buf, uint len) {
+    return sys_sendrecv(SYS_REPLY_RECV, client, msg, size, from, sender, buf,
+                        len, NULL, NULL);
+}
+
+uint sys_reply_recv_page(int client, char* msg, uint size, char* page,
+                         int from, int* sender, char* buf, uint len) {
+    return sys_sendrecv(SYS_REPLY_RECV, client, msg, size, from, sender, buf,
+                        len, page, NULL);
+}
+
+int sys_send(int receiver, char* msg, uint size) {
+    return sys_sendv(receiver, msg, size, NULL, 0);
+}
+
+uint sys_recv(int from, int* sender, char* buf, uint size) {
+    return sys_recvv(from, sender, buf, size, NULL, 0);
+}
+
+void sys_doorbell(int chan) {
+    sc->type     = SYS_DOORBELL;
+    sc->receiver = chan;
+    asm("ecall");
+}
+
+void sys_sleep(uint usec) {
+    sc->type = SYS_SLEEP;
+    sc->len  = usec;
+    asm("ecall");
+}
+
+void sys_bell_wait(int chan) {
+    sc->type     = SYS_BELL_WAIT;
+    sc->receiver = chan;
+    asm("ecall");
 }
@@ -1,21 +1,88 @@
 #pragma once
 
 #include "servers.h"
+#include <stddef.h>
 
 enum syscall_type {
     SYS_UNUSED,
     SYS_RECV, /* 1 */
     SYS_SEND, /* 2 */
+    SYS_CALL,       /* 3: SYS_SEND, then SYS_RECV from the receiver */
+    SYS_REPLY_RECV, /* 4: SYS_SEND, then SYS_RECV with the sender filter */
+    SYS_DOORBELL,   /* 5: notify the peer of channel #receiver           */
+    SYS_CALL_WAIT,  /* 6: a SYS_CALL waiting for its reply (kernel only) */
+    SYS_FAULT,      /* 7: a page fault sent to GPID_PROCESS (kernel only) */
+    SYS_FAULT_WAIT, /* 8: a SYS_FAULT waiting for the page (kernel only)  */
+    SYS_SLEEP,      /* 9: sleep for len microseconds                     */
+    SYS_BELL_WAIT,  /* 10: wait for the doorbell of channel #receiver    */
 };
+#define IS_SEND(x)                                                             \
+    ((x) == SYS_SEND || (x) == SYS_CALL || (x) == SYS_REPLY_RECV ||            \
+     (x) == SYS_FAULT)
+#define IS_RECV(x)                                                             \
+    ((x) == SYS_RECV || (x) == SYS_CALL_WAIT || (x) == SYS_FAULT_WAIT)
 
+#define PAGE_SIZE       4096
 #define SYSCALL_MSG_LEN 1024
 struct syscall {
-    enum syscall_type type; /* SYS_SEND or SYS_RECV */
+    enum syscall_type type; /* SYS_SEND, SYS_RECV, ...  */
     int sender;             /* sender process ID    */
     int receiver;           /* receiver process ID  */
+    uint len;               /* bytes used in content */
+    uint send_page;         /* page sent along with the message, or 0    */
+    uint recv_page;         /* where to receive a page, or 0; after the
+                               system call, 0 if no page was received */
+    /* FAILED if the peer does not exist or exits during the call */
+    enum { PENDING, DONE, FAILED } status;
     char content[SYSCALL_MSG_LEN];
-    enum { PENDING, DONE } status;
 };
+/* The kernel only copies the header and the first len bytes of content. */
+#define SYSCALL_HDR_LEN offsetof(struct syscall, content)
 
-void sys_send(int receiver, char* msg, uint size);
-void sys_recv(int from, int* sender, char* buf, uint size);
+/* A send returns -1, and a receive returns SYS_FAILED without touching the
+ * buffer, if the peer does not exist or exits before the message passes. */
+#define SYS_FAILED ((uint)-1)
+int sys_send(int receiver, char* msg, uint size);
+uint sys_recv(int from, int* sender, char* buf, uint size);
+/* Scatter/gather: a message is hdr (hdr_len bytes) followed by body. */
+int sys_sendv(int receiver, char* hdr, uint hdr_len, char* body, uint body_len);
+uint sys_recvv(int from, int* sender, char* hdr, uint hdr_len, char* body,
+               uint body_len);
+/* Send a request to a server and wait for its reply in a single trap. */
+uint sys_call(int receiver, char* msg, uint size, char* buf, uint len);
+/* Reply to a client and wait for the next request in a single trap. */
+uint sys_reply_recv(int client, char* msg, uint size, int from, int* sender,
+                    char* buf, uint len);
+void sys_doorbell(int chan);
+void sys_sleep(uint usec);
+void sys_bell_wait(int chan);
+/* Send or receive a page-aligned page of memory with a message. The kernel
+ * remaps the page of the sender to the receiver instead of copying it, and
+ * the page of the receiver (if any) to the sender in return; the return
+ * value of sys_call_page() tells whether a page has been received. */
+int sys_send_page(int receiver, char* msg, uint size, char* page);
+uint sys_call_page(int receiver, char* msg, uint size, char* buf, uint len,
+                   char* page);
+uint sys_reply_recv_page(int client, char* msg, uint size, char* page,
+                         int from, int* sender, char* buf, uint len);
+
+/* A channel is a single-producer/single-consumer byte ring in a page shared
+ * by a process and a server, mapped at CHANNEL_ADDR(chan) in both. Writing
+ * to an empty ring rings the doorbell of the consumer, which receives it as
+ * an empty message from the producer in sys_recv; a SYS_CALL never returns
+ * a doorbell instead of its reply. chan_write() blocks in sys_bell_wait()
+ * while the ring is full, and only then does chan_read() ring the doorbell
+ * of the producer; chan_read() never blocks. */
+#define NCHANNELS        8
+#define CHANNEL_ADDR(x)  (CHANNEL_BASE + (x) * PAGE_SIZE)
+#define CHAN_RING_SIZE   (PAGE_SIZE - 3 * sizeof(uint))
+struct chan_ring {
+    uint head; /* next byte to read, only written by the consumer  */
+    uint tail; /* next byte to write, only written by the producer */
+    uint wait; /* set by the producer waiting for room in the ring */
+    char data[CHAN_RING_SIZE];
+};
+
+int chan_open(int server);
+uint chan_write(int chan, char* buf, uint len);
+uint chan_read(int chan, char* buf, uint len);
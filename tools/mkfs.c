@@ -82,6 +82,8 @@ int main() {
     for (uint i = 0; i < EGOS_BIN_NUM; i++) {
         int sz = load_file(egos_binaries[i], exec + i * EGOS_BIN_MAX_NBYTE);
         printf("[INFO] Load %s: %d bytes\n", egos_binaries[i], sz);
+        /* The image for the video demo app takes the rest of exec[]. */
+        assert(i == EGOS_BIN_NUM - 1 || sz <= EGOS_BIN_MAX_NBYTE);
     }
 
     /* Initialize the file system using the fs[] buffer as a ramdisk. */
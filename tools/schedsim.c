@@ -0,0 +1,264 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: host-side scheduler simulator
+ * Compile grass/process.c natively with a fake mtime_get() and a fake earth
+ * interface, and drive the same selection logic as proc_yield() with a
+ * synthetic workload of CPU-bound, I/O-bound, interactive and sleep-heavy
+ * processes. Report turnaround, response time, fairness and the number of
+ * scheduling decisions per second, so that a scheduling policy can be
+ * evaluated in seconds without booting QEMU.
+ *
+ * Usage: ./schedsim [ncpu] [nio] [ninteractive] [nsleep] [seed] [-s] [-w] [-v]
+ *     -s: use the stride scheduler instead of MLFQ
+ *     -w: give the i-th CPU-bound process (i+1) times the default tickets
+ *     -v: print the [STATS] lines of grass/process.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "process.h"
+#undef printf
+
+#define QUANTUM 100000UL /* the QEMU quantum in earth/cpu_intr.c */
+
+/* The kernel state and the earth interface that grass/process.c links with. */
+struct process proc_set[PROC_SET_SIZE];
+uint core_in_kernel, core_to_proc_idx[NCORES];
+ulonglong core_idle_time[NCORES];
+static void mmu_free(int pid) {}
+static uint tty_input_empty() { return 1; }
+static struct earth fake_earth = {.mmu_free        = mmu_free,
+                                  .tty_input_empty = tty_input_empty};
+struct earth* earth = &fake_earth;
+
+static ulonglong now; /* the simulated mtime */
+ulonglong mtime_get() { return now; }
+
+static int verbose;
+int my_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (verbose) vprintf(format, args);
+    va_end(args);
+    return 0;
+}
+
+int FATAL(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[FATAL] ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+/* Every kind of process alternates CPU bursts and sleeps until its total
+ * CPU demand is met; all times are in mtime ticks. */
+enum task_kind { CPU_BOUND, IO_BOUND, INTERACTIVE, SLEEP_HEAVY, NKINDS };
+struct task_kind_info {
+    char* name;
+    uint work, burst_min, burst_max, sleep_min, sleep_max;
+} kinds[NKINDS] = {
+    {"cpu-bound", 3000000, 3000000, 3000000, 0, 0},
+    {"io-bound", 500000, 5000, 20000, 50000, 200000},
+    {"interactive", 100000, 1000, 5000, 200000, 1000000},
+    {"sleep-heavy", 20000, 200, 1000, 1000000, 3000000},
+};
+
+struct task {
+    int kind, pid, tickets;
+    ulonglong work, burst, wake_time;
+    ulonglong arrival, created, first_run, finished;
+    ulonglong latency_sum, latency_max, nwakeups;
+    ulonglong cpu, cpu_start, cpu_end; /* CPU time, see fairness below */
+} tasks[MAX_NPROCESS];
+uint ntasks;
+
+static uint seed = 2000;
+static uint rand_range(uint lo, uint hi) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return hi > lo ? lo + seed % (hi - lo + 1) : lo;
+}
+
+static struct task* task_of(int pid) {
+    for (uint i = 0; i < ntasks; i++)
+        if (tasks[i].pid == pid) return &tasks[i];
+    FATAL("schedsim: unknown pid %d", pid);
+    return NULL;
+}
+
+static ulonglong min(ulonglong a, ulonglong b) { return a < b ? a : b; }
+
+/* The CPU-bound processes all compete for the CPU from the arrival of the
+ * last one until the first one finishes; fairness is measured on the CPU
+ * time that each of them gets in this interval. */
+static void snapshot_cpu(int end) {
+    for (uint i = 0; i < ntasks; i++)
+        if (tasks[i].kind == CPU_BOUND)
+            *(end ? &tasks[i].cpu_end : &tasks[i].cpu_start) = tasks[i].cpu;
+}
+
+static ulonglong next_arrival() {
+    ulonglong t = (ulonglong)-1;
+    for (uint i = 0; i < ntasks; i++)
+        if (!tasks[i].pid) t = min(t, tasks[i].arrival);
+    return t;
+}
+
+int main(int argc, char** argv) {
+    uint nkind[NKINDS] = {4, 2, 2, 2}, nargs = 0, weighted = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = 1;
+        else if (strcmp(argv[i], "-s") == 0) sched = &stride_ops;
+        else if (strcmp(argv[i], "-w") == 0) weighted = 1;
+        else if (nargs < NKINDS) nkind[nargs++] = atoi(argv[i]);
+        else seed = atoi(argv[i]);
+    }
+
+    /* Keep the pids of the 4 kernel processes, which never become ready. */
+    for (uint i = GPID_PROCESS; i < GPID_USER_START; i++) proc_alloc();
+
+    for (uint k = 0; k < NKINDS; k++)
+        for (uint i = 0; i < nkind[k]; i++) {
+            if (ntasks == MAX_NPROCESS - GPID_USER_START + 1)
+                FATAL("schedsim: at most %d processes",
+                      MAX_NPROCESS - GPID_USER_START + 1);
+            struct task* t = &tasks[ntasks++];
+            t->kind        = k;
+            t->work        = kinds[k].work;
+            t->burst = min(t->work, rand_range(kinds[k].burst_min,
+                                               kinds[k].burst_max));
+            t->arrival = rand_range(0, 5 * QUANTUM);
+            t->tickets = STRIDE_DEFAULT_TICKETS;
+            if (weighted && k == CPU_BOUND) t->tickets *= i + 1;
+        }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ulonglong decisions = 0, idle = 0;
+    uint ncpu_arrived = 0, ncpu_done = 0;
+    for (uint ndone = 0; ndone < ntasks;) {
+        /* Admit the processes that have arrived. */
+        for (uint i = 0; i < ntasks; i++)
+            if (!tasks[i].pid && tasks[i].arrival <= now) {
+                tasks[i].pid     = proc_alloc();
+                tasks[i].created = now;
+                proc_set_tickets(tasks[i].pid, tasks[i].tickets);
+                proc_set_ready(tasks[i].pid);
+                if (tasks[i].kind == CPU_BOUND &&
+                    ++ncpu_arrived == nkind[CPU_BOUND])
+                    snapshot_cpu(0);
+            }
+
+        struct process* p = proc_next();
+        decisions++;
+        if (p == NULL) {
+            /* Idle until the next wakeup or arrival. */
+            ulonglong next = min(proc_next_wakeup(), next_arrival());
+            idle += next - now;
+            now = next;
+            continue;
+        }
+
+        struct task* t = task_of(p->pid);
+        if (!p->has_started) t->first_run = now;
+        if (t->wake_time) {
+            ulonglong latency = now - t->wake_time;
+            t->latency_sum += latency;
+            t->latency_max = latency > t->latency_max ? latency : t->latency_max;
+            t->nwakeups++;
+            t->wake_time = 0;
+        }
+        proc_set_running(p->pid);
+
+        /* Run until the timer interrupt or the end of the CPU burst. */
+        ulonglong timer = min(now + sched->slice(p) * QUANTUM, proc_next_wakeup());
+        ulonglong ran   = min(timer - now, t->burst);
+        now += ran;
+        t->burst -= ran;
+        t->work -= ran;
+        t->cpu += ran;
+
+        if (t->burst) {
+            /* Timer interrupt: the same accounting as intr_entry(). */
+            p->t_cpu += ran;
+            p->num_interrupts++;
+            sched->on_tick(p, ran);
+            proc_set_runnable(p->pid);
+            continue;
+        }
+
+        /* End of the CPU burst: the same accounting as excp_entry(). */
+        sched->on_block(p, ran);
+        if (t->work == 0) {
+            t->finished = now;
+            if (t->kind == CPU_BOUND && ncpu_done++ == 0) snapshot_cpu(1);
+            proc_free(p->pid);
+            ndone++;
+        } else {
+            uint usec = rand_range(kinds[t->kind].sleep_min,
+                                   kinds[t->kind].sleep_max);
+            t->wake_time = now + usec;
+            t->burst = min(t->work, rand_range(kinds[t->kind].burst_min,
+                                               kinds[t->kind].burst_max));
+            proc_sleep(p->pid, usec);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wall = (end.tv_sec - start.tv_sec) +
+                  (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    /* Report the statistics of every kind of process in ms. */
+    printf("%-12s %5s %15s %15s %15s %15s\n", "kind", "count",
+           "turnaround(ms)", "response(ms)", "wakeup avg(ms)", "wakeup max(ms)");
+    for (uint k = 0; k < NKINDS; k++) {
+        ulonglong cnt = 0, turnaround = 0, response = 0;
+        ulonglong latency = 0, nwakeups = 0, latency_max = 0;
+        for (uint i = 0; i < ntasks; i++) {
+            struct task* t = &tasks[i];
+            if (t->kind != k) continue;
+            cnt++;
+            turnaround += t->finished - t->created;
+            response += t->first_run - t->created;
+            latency += t->latency_sum;
+            nwakeups += t->nwakeups;
+            if (t->latency_max > latency_max) latency_max = t->latency_max;
+        }
+        if (!cnt) continue;
+        printf("%-12s %5llu %15.3f %15.3f %15.3f %15.3f\n", kinds[k].name, cnt,
+               turnaround / cnt / 1000.0, response / cnt / 1000.0,
+               nwakeups ? latency / nwakeups / 1000.0 : 0.0,
+               latency_max / 1000.0);
+    }
+
+    /* Jain's fairness index over the CPU time per ticket that CPU-bound
+     * processes get while they all compete (see snapshot_cpu), which is 1
+     * if the CPU time is shared in proportion to the tickets. */
+    double sum = 0, sum_sq = 0;
+    uint n = 0;
+    for (uint i = 0; i < ntasks; i++)
+        if (tasks[i].kind == CPU_BOUND) {
+            double x = (double)(tasks[i].cpu_end - tasks[i].cpu_start) /
+                       tasks[i].tickets;
+            sum += x;
+            sum_sq += x * x;
+            n++;
+        }
+
+    printf("policy: %s%s\n", sched->name, weighted ? " (weighted)" : "");
+    printf("fairness (Jain, cpu-bound): %.4f\n", n ? sum * sum / (n * sum_sq) : 1.0);
+    printf("simulated time: %.3f ms (idle %.3f ms)\n", now / 1000.0, idle / 1000.0);
+    printf("decisions: %llu in %.6f s (%.0f decisions/s)\n", decisions, wall,
+           wall > 0 ? decisions / wall : 0.0);
+    return 0;
+}